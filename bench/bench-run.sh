@@ -0,0 +1,8 @@
+# Compile benchmarks (needs Google Benchmark, e.g. libbenchmark-dev):
+clang++ -O2 -o eva-bench `llvm-config --cxxflags --ldflags --system-libs --libs core orcjit native passes bitreader bitwriter` -fexceptions -std=c++17 bench/eva-bench.cpp -lbenchmark -lpthread
+
+# Run benchmarks (corpora of 64 ... 65536 forms):
+./eva-bench
+
+# Smaller corpora, only the parser:
+./eva-bench --max-size=4096 --benchmark_filter=Parse
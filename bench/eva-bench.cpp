@@ -0,0 +1,250 @@
+/**
+ * Eva LLVM benchmarks: tokenizer, parser, code generation, and
+ * end-to-end JIT execution, on synthetic programs.
+ *
+ * Usage: eva-bench [--max-size=<n>] [benchmark options]
+ *
+ * Corpora are generated at sizes from 64 up to `--max-size` (65536 by
+ * default), growing 8x; the JIT runs up to 1/64 of it. The size is the
+ * number of top-level forms, of list entries (wide), or of nesting
+ * levels (deep). Other options are the Google Benchmark ones, e.g.
+ * --benchmark_filter=Parse.
+ */
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../src/EvaLLVM.h"
+
+// ------------------------------------------------------------------
+// Synthetic corpora.
+
+/**
+ * Top-level forms declaring, updating and combining variables:
+ *
+ *   (var x0 (+ 0 (* 2 3)))
+ *   (set x0 (- x0 1))
+ *   (var x1 (+ x0 (* 2 3)))
+ *   ...
+ */
+static std::string makeProgram(size_t forms) {
+  std::string program;
+
+  for (size_t i = 0; i < forms; i++) {
+    auto var = "x" + std::to_string(i);
+    auto prev = i == 0 ? std::string("0") : "x" + std::to_string(i - 1);
+
+    if (i % 2 == 0) {
+      program += "(var " + var + " (+ " + prev + " (* 2 3)))\n";
+    } else {
+      program += "(var " + var + " " + prev + ")\n";
+      program += "(set " + var + " (- " + var + " 1))\n";
+    }
+  }
+  return program;
+}
+
+/**
+ * Deeply nested list: (+ 1 (+ 1 ... (+ 1 1)))
+ */
+static std::string makeDeep(size_t depth) {
+  std::string program;
+
+  for (size_t i = 0; i < depth; i++) {
+    program += "(+ 1 ";
+  }
+  program += "1";
+  program.append(depth, ')');
+  return program;
+}
+
+/**
+ * Very wide list: (begin 0 x "s" 3 x "s" ...)
+ */
+static std::string makeWide(size_t width) {
+  std::string program = "(begin";
+
+  for (size_t i = 0; i < width; i++) {
+    switch (i % 3) {
+      case 0:
+        program += " " + std::to_string(i);
+        break;
+      case 1:
+        program += " x";
+        break;
+      default:
+        program += " \"s\"";
+        break;
+    }
+  }
+  program += ")";
+  return program;
+}
+
+// ------------------------------------------------------------------
+// Benchmarks.
+
+/**
+ * Exposes the compiler phases to the benchmarks.
+ */
+class BenchEva : public EvaLLVM {
+  public:
+    using EvaLLVM::EvaLLVM;
+    using EvaLLVM::parse;
+    using EvaLLVM::compile;
+};
+
+/**
+ * Tokenizer::getNextToken throughput.
+ */
+static void BM_Tokenize(benchmark::State& state) {
+  auto program = makeProgram(state.range(0));
+  syntax::Tokenizer tokenizer;
+  size_t tokens = 0;
+
+  for (auto _ : state) {
+    tokenizer.initString(program);
+    while (tokenizer.getNextToken().type != syntax::TokenType::__EOF) {
+      tokens++;
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations() * program.size());
+  state.counters["tokens/s"] =
+      benchmark::Counter(tokens, benchmark::Counter::kIsRate);
+}
+
+/**
+ * Tokenizer::tokenize throughput, into a reused buffer.
+ */
+static void BM_TokenizeBulk(benchmark::State& state) {
+  auto program = makeProgram(state.range(0));
+  syntax::Tokenizer tokenizer;
+  std::vector<syntax::Token> tokens;
+  size_t count = 0;
+
+  for (auto _ : state) {
+    tokenizer.initString(program);
+    tokenizer.tokenize(tokens);
+    count += tokens.size();
+  }
+
+  state.SetBytesProcessed(state.iterations() * program.size());
+  state.counters["tokens/s"] =
+      benchmark::Counter(count, benchmark::Counter::kIsRate);
+}
+
+/**
+ * EvaParser::parse of a corpus.
+ */
+static void parseCorpus(benchmark::State& state, const std::string& program) {
+  syntax::EvaParser parser;
+
+  for (auto _ : state) {
+    auto ast = parser.parse(program);
+    benchmark::DoNotOptimize(ast);
+  }
+
+  state.SetBytesProcessed(state.iterations() * program.size());
+  state.counters["nodes"] = parser.ast.size();
+}
+
+static void BM_ParseDeep(benchmark::State& state) {
+  parseCorpus(state, makeDeep(state.range(0)));
+}
+
+static void BM_ParseWide(benchmark::State& state) {
+  parseCorpus(state, makeWide(state.range(0)));
+}
+
+static void BM_ParseProgram(benchmark::State& state) {
+  parseCorpus(state, "(begin " + makeProgram(state.range(0)) + ")");
+}
+
+/**
+ * EvaLLVM::gen of var/set/arithmetic forms (parsing excluded).
+ */
+static void BM_Gen(benchmark::State& state) {
+  auto program = "(begin " + makeProgram(state.range(0)) + ")";
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto vm = std::make_unique<BenchEva>();
+    auto ast = vm->parse(program);
+    state.ResumeTiming();
+
+    vm->compile(ast);
+
+    state.PauseTiming();
+    vm.reset();
+    state.ResumeTiming();
+  }
+
+  state.counters["forms/s"] = benchmark::Counter(
+      state.iterations() * state.range(0), benchmark::Counter::kIsRate);
+}
+
+/**
+ * End-to-end: parse, compile, optimize (at the -O level of the second
+ * argument), JIT-compile and run.
+ */
+static void BM_JIT(benchmark::State& state) {
+  auto program = makeProgram(state.range(0));
+
+  EvaOptions options;
+  options.mode = ExecMode::JIT;
+  options.optLevel = state.range(1);
+
+  for (auto _ : state) {
+    EvaLLVM vm(options);
+    benchmark::DoNotOptimize(vm.exec(program));
+  }
+
+  state.counters["forms/s"] = benchmark::Counter(
+      state.iterations() * state.range(0), benchmark::Counter::kIsRate);
+}
+
+int main(int argc, char** argv) {
+  int64_t maxSize = 1 << 16;
+
+  // Own options, the rest is for Google Benchmark:
+  auto benchArgc = 1;
+  for (auto i = 1; i < argc; i++) {
+    auto arg = std::string_view(argv[i]);
+
+    if (arg.substr(0, 11) == "--max-size=") {
+      maxSize = std::max<int64_t>(64, atoll(argv[i] + 11));
+    } else {
+      argv[benchArgc++] = argv[i];
+    }
+  }
+  argc = benchArgc;
+
+  auto sizes = benchmark::CreateRange(64, maxSize, 8);
+
+  benchmark::RegisterBenchmark("Tokenize", BM_Tokenize)->ArgsProduct({sizes});
+  benchmark::RegisterBenchmark("TokenizeBulk", BM_TokenizeBulk)
+      ->ArgsProduct({sizes});
+  benchmark::RegisterBenchmark("ParseDeep", BM_ParseDeep)->ArgsProduct({sizes});
+  benchmark::RegisterBenchmark("ParseWide", BM_ParseWide)->ArgsProduct({sizes});
+  benchmark::RegisterBenchmark("ParseProgram", BM_ParseProgram)
+      ->ArgsProduct({sizes});
+  benchmark::RegisterBenchmark("Gen", BM_Gen)->ArgsProduct({sizes});
+  // Unoptimized JIT of a large `main` is slow, up to 1/64 of the size:
+  auto jitSizes =
+      benchmark::CreateRange(64, std::max<int64_t>(64, maxSize / 64), 8);
+
+  benchmark::RegisterBenchmark("JIT", BM_JIT)
+      ->ArgsProduct({jitSizes, {0, 2}})
+      ->Unit(benchmark::kMillisecond);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -1,8 +1,14 @@
 # Compile main:
-clang++ -o eva-llvm `llvm-config --cxxflags --ldflags --system-libs --libs core` -fexceptions src/eva-llvm.cpp
+clang++ -o eva-llvm `llvm-config --cxxflags --ldflags --system-libs --libs core orcjit native passes bitreader bitwriter` -fexceptions -std=c++17 src/eva-llvm.cpp
 
 # Run main:
 ./eva-llvm
 
 # Execute generated IR:
 lli ./out.ll
+
+# Run in-process (JIT):
+./eva-llvm --jit
+
+# Compile a native executable and run it:
+./eva-llvm --emit-exe -O2 -march=native -o out && ./out
@@ -5,30 +5,41 @@
 #ifndef Environment_h
 #define Environment_h
 
-#include <map>
-#include <memory>
-#include <string>
+#include <vector>
 
 #include "Logger.h"
 #include "llvm/IR/Value.h"
+#include "parser/Interner.h"
 
 /**
  * Environment: names storage
+ *
+ * One flat table for all the scopes: each symbol has a stack of
+ * bindings, the innermost on top. Symbols are dense interned handles,
+ * so a binding stack is found by index, and a lookup costs the same
+ * however deeply the scopes are nested.
+ *
+ * Every binding is also recorded in an undo log, and a scope is a
+ * marker in that log: exiting the scope pops the bindings made since
+ * the marker.
  */
-class Environment : public std::enable_shared_from_this<Environment> {
+class Environment {
   public:
     /**
-     * Creates an environment with the given record
+     * Creates an environment, `names` are used for error reporting.
      */
-    Environment(std::map<std::string, llvm::Value*> record,
-        std::shared_ptr<Environment> parent)
-      : record_(record), parent_(parent) {}
+    explicit Environment(const Interner& names) : names_(names) {}
 
-    /** 
+    /**
      * Creates a variable with the given name and value
+     * in the current scope.
      */
-    llvm::Value* define(const std::string& name, llvm::Value* value) {
-      record_[name] = value;
+    llvm::Value* define(Symbol name, llvm::Value* value) {
+      if (name >= bindings_.size()) {
+        bindings_.resize(name + 1);
+      }
+      bindings_[name].push_back(value);
+      undo_.push_back(name);
       return value;
     }
 
@@ -36,37 +47,95 @@ class Environment : public std::enable_shared_from_this<Environment> {
      * Returns the value of a defined variable, or throws
      * if the variable is not defined.
      */
-    llvm::Value* lookup(const std::string& name) {
-      return resolve(name)->record_[name];
+    llvm::Value* lookup(Symbol name) {
+      auto value = find(name);
+      if (value == nullptr) {
+        DIE << "Variable \"" << names_.name(name) << "\" is not defined.";
+      }
+      return value;
     }
 
-  private:
+    /**
+     * Returns the value of a variable, or null if it is not defined.
+     */
+    llvm::Value* find(Symbol name) const {
+      if (name >= bindings_.size() || bindings_[name].empty()) {
+        return nullptr;
+      }
+      return bindings_[name].back();
+    }
 
     /**
-     * Returns specific environment in which a variable is defined, or
-     * throws if a variable is not defined
+     * Enters a new (block) scope.
      */
-    std::shared_ptr<Environment> resolve(const std::string& name) {
-      if (record_.count(name) != 0) {
-        return shared_from_this();
+    void enterScope() {
+      scopes_.push_back(undo_.size());
+      scopesEntered_++;
+    }
+
+    /**
+     * Exits the current scope, dropping its bindings.
+     */
+    void exitScope() {
+      auto marker = scopes_.back();
+      scopes_.pop_back();
+
+      while (undo_.size() > marker) {
+        bindings_[undo_.back()].pop_back();
+        undo_.pop_back();
       }
+    }
+
+    /**
+     * Number of open scopes.
+     */
+    size_t depth() const { return scopes_.size(); }
 
-      if (parent_ == nullptr) {
-        DIE << "Variable\"" << name << "\" is not defined.";
+    /**
+     * Exits the scopes opened after the `depth` (e.g. left open by an
+     * error).
+     */
+    void exitScopes(size_t depth) {
+      while (scopes_.size() > depth) {
+        exitScope();
       }
-      
-      return parent_->resolve(name);
     }
 
     /**
-     * Bindings storage
+     * Drops all the bindings and scopes.
      */
-    std::map<std::string, llvm::Value*> record_;
+    void clear() {
+      bindings_.clear();
+      undo_.clear();
+      scopes_.clear();
+    }
 
-    /** 
-     * Parent link
+    /**
+     * Number of scopes entered so far.
+     */
+    size_t scopesEntered() const { return scopesEntered_; }
+
+  private:
+    /**
+     * Symbol -> stack of its bindings.
+     */
+    std::vector<std::vector<llvm::Value*>> bindings_;
+
+    /**
+     * Symbols in the order they were bound.
+     */
+    std::vector<Symbol> undo_;
+
+    /**
+     * Scope markers: size of the undo log at scope entry.
+     */
+    std::vector<size_t> scopes_;
+    size_t scopesEntered_ = 0;
+
+    /**
+     * Symbol names.
      */
-    std::shared_ptr<Environment> parent_;
+    const Interner& names_;
 };
 
 
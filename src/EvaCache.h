@@ -0,0 +1,122 @@
+/**
+ * On-disk compilation cache.
+ */
+#ifndef EvaCache_h
+#define EvaCache_h
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+/**
+ * Compiler build, part of the cache keys: a rebuilt compiler may
+ * generate other code for the same program. Defaults to the build time;
+ * define it (e.g. -DEVA_BUILD_ID=\"<git commit>\") to share the cache
+ * between builds of the same sources.
+ */
+#ifndef EVA_BUILD_ID
+#define EVA_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+/**
+ * Compilation cache: optimized modules stored as bitcode, keyed by
+ * the SHA-1 of the program text, the compiler options and build, and
+ * the LLVM version.
+ */
+class EvaCache {
+  public:
+    explicit EvaCache(const std::string& dir) : dir_(dir) {}
+
+    /**
+     * Cache key of a program: the options fingerprint should contain
+     * everything that changes the compiled module.
+     */
+    static std::string key(std::string_view program,
+                           const std::string& options) {
+      auto environment =
+          options + "/LLVM-" LLVM_VERSION_STRING "/eva-" EVA_BUILD_ID;
+
+      // Each input is prefixed with its length, so no two different
+      // (environment, program) pairs hash the same bytes.
+      llvm::SHA1 hash;
+      hash.update(std::to_string(environment.size()) + ":");
+      hash.update(environment);
+      hash.update(std::to_string(program.size()) + ":");
+      hash.update(llvm::StringRef(program));
+      return llvm::toHex(hash.final(), /* LowerCase */ true);
+    }
+
+    /**
+     * Loads a cached module, returns null on a cache miss.
+     */
+    std::unique_ptr<llvm::Module> load(const std::string& key,
+                                       llvm::LLVMContext& ctx) {
+      auto buffer = llvm::MemoryBuffer::getFile(getPath(key));
+      if (!buffer) {
+        return nullptr;
+      }
+
+      auto module = llvm::parseBitcodeFile((*buffer)->getMemBufferRef(), ctx);
+      if (!module) {
+        // Stale or corrupted entry: recompile.
+        llvm::consumeError(module.takeError());
+        return nullptr;
+      }
+      return std::move(*module);
+    }
+
+    /**
+     * Stores a module. The entry is written to a temporary file and
+     * renamed, so concurrent runs never see a partial entry.
+     */
+    void store(const std::string& key, const llvm::Module& module) {
+      if (llvm::sys::fs::create_directories(dir_)) {
+        return;
+      }
+
+      auto path = getPath(key);
+      auto tmpPath =
+          path + ".tmp" + std::to_string(llvm::sys::Process::getProcessId());
+
+      {
+        std::error_code errorCode;
+        llvm::raw_fd_ostream out(tmpPath, errorCode, llvm::sys::fs::OF_None);
+        if (errorCode) {
+          return;
+        }
+        llvm::WriteBitcodeToFile(module, out);
+      }
+
+      if (llvm::sys::fs::rename(tmpPath, path)) {
+        llvm::sys::fs::remove(tmpPath);
+      }
+    }
+
+  private:
+    std::string getPath(const std::string& key) {
+      llvm::SmallString<128> path(dir_);
+      llvm::sys::path::append(path, key + ".bc");
+      return path.str().str();
+    }
+
+    /**
+     * Cache directory.
+     */
+    std::string dir_;
+};
+
+#endif//EvaCache_h
@@ -0,0 +1,161 @@
+/**
+ * In-process JIT for the compiled modules.
+ */
+#ifndef EvaJIT_h
+#define EvaJIT_h
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include "Logger.h"
+
+/**
+ * ORC LLJIT wrapper: compiles modules to native code in memory, and
+ * resolves external calls (e.g. `printf`) in the host process.
+ */
+class EvaJIT {
+  public:
+    /**
+     * With `compileThreads` > 1, modules are compiled concurrently on a
+     * pool of threads (see `addModule(module, partitions)`).
+     */
+    explicit EvaJIT(unsigned compileThreads = 1) {
+      llvm::InitializeNativeTarget();
+      llvm::InitializeNativeTargetAsmPrinter();
+
+      llvm::orc::LLJITBuilder builder;
+      if (compileThreads > 1) {
+        builder.setNumCompileThreads(compileThreads);
+      }
+      jit_ = check(builder.create());
+
+      auto& DL = jit_->getDataLayout();
+      jit_->getMainJITDylib().addGenerator(check(
+          llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+              DL.getGlobalPrefix())));
+    }
+
+    /**
+     * Adds a module to the JIT, the module is compiled lazily on
+     * the first lookup of its symbols.
+     */
+    void addModule(std::unique_ptr<llvm::Module> module,
+                   std::unique_ptr<llvm::LLVMContext> ctx) {
+      check(jit_->addIRModule(
+          llvm::orc::ThreadSafeModule(std::move(module), std::move(ctx))));
+    }
+
+    /**
+     * Adds a module of a context shared with other modules (e.g. one
+     * module per form of a session).
+     */
+    void addModule(std::unique_ptr<llvm::Module> module,
+                   llvm::orc::ThreadSafeContext ctx) {
+      check(jit_->addIRModule(
+          llvm::orc::ThreadSafeModule(std::move(module), std::move(ctx))));
+    }
+
+    /**
+     * Adds a module split into partitions of its functions, and compiles
+     * them at once: concurrently, with compile threads.
+     *
+     * Each partition gets a context of its own (the modules of a context
+     * are compiled one at a time). Local symbols used by several
+     * partitions are externalized.
+     */
+    void addModule(std::unique_ptr<llvm::Module> module, unsigned partitions) {
+      std::vector<std::string> roots;
+
+      llvm::SplitModule(
+          *module, partitions,
+          [this, &roots](std::unique_ptr<llvm::Module> part) {
+            llvm::SmallVector<char, 0> bitcode;
+            llvm::raw_svector_ostream out(bitcode);
+            llvm::WriteBitcodeToFile(*part, out);
+
+            auto ctx = std::make_unique<llvm::LLVMContext>();
+            auto copy = check(llvm::parseBitcodeFile(
+                llvm::MemoryBufferRef(
+                    llvm::StringRef(bitcode.data(), bitcode.size()),
+                    part->getModuleIdentifier()),
+                *ctx));
+
+            // Externalized locals are hidden, which the JIT doesn't
+            // resolve across modules.
+            for (auto& value : copy->global_values()) {
+              if (value.hasHiddenVisibility()) {
+                value.setVisibility(llvm::GlobalValue::DefaultVisibility);
+              }
+            }
+
+            // A defined symbol of the partition, to compile it.
+            for (auto& fn : copy->functions()) {
+              if (!fn.isDeclaration() && !fn.hasLocalLinkage()) {
+                roots.push_back(fn.getName().str());
+                break;
+              }
+            }
+            addModule(std::move(copy), std::move(ctx));
+          },
+          /* PreserveLocals */ false);
+
+      // One lookup of all the partitions, compiled in parallel:
+      auto& ES = jit_->getExecutionSession();
+      llvm::orc::SymbolLookupSet symbols;
+      for (auto& root : roots) {
+        symbols.add(jit_->mangleAndIntern(root));
+      }
+      check(ES.lookup(
+          llvm::orc::makeJITDylibSearchOrder(&jit_->getMainJITDylib()),
+          symbols));
+    }
+
+    /**
+     * Returns the address of a compiled symbol.
+     */
+    template <typename T>
+    T lookup(const std::string& name) {
+      auto symbol = check(jit_->lookup(name));
+      return (T)symbol.getAddress();
+    }
+
+    /**
+     * Data layout of the host target.
+     */
+    const llvm::DataLayout& getDataLayout() { return jit_->getDataLayout(); }
+
+  private:
+    /**
+     * Unwraps an expected value, or dies with its error.
+     */
+    template <typename T>
+    static T check(llvm::Expected<T> value) {
+      if (!value) {
+        DIE << "JIT: " << llvm::toString(value.takeError()) << "\n";
+      }
+      return std::move(*value);
+    }
+
+    static void check(llvm::Error error) {
+      if (error) {
+        DIE << "JIT: " << llvm::toString(std::move(error)) << "\n";
+      }
+    }
+
+    /**
+     * ORC JIT instance.
+     */
+    std::unique_ptr<llvm::orc::LLJIT> jit_;
+};
+
+#endif//EvaJIT_h
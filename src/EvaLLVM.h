@@ -4,83 +4,809 @@
 #ifndef EvaLLVM_h
 #define EvaLLVM_h
 
-#include <regex>
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <optional>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 #include "Environment.h"
+#include "EvaCache.h"
+#include "EvaJIT.h"
+#include "EvaOptimizer.h"
+#include "EvaProfiler.h"
+#include "EvaRuntime.h"
+#include "EvaTarget.h"
 #include "parser/EvaParser.h"
+#include "parser/FormReader.h"
 
 using syntax::EvaParser;
 
 /**
- * Environment type.
+ * What `exec` does with the compiled module.
  */
-using Env = std::shared_ptr<Environment>;
+enum class ExecMode {
+  // Print the IR and save it to `out.ll` (to be run with `lli`).
+  Emit,
 
-// Generic binary operator:
-#define GEN_BINARY_OP(Op, varName)          \
-  do {                                      \
-    auto op1 = gen(exp.list[1], env);       \
-    auto op2 = gen(exp.list[2], env);       \
-    return builder->Op(op1, op2, varName);  \
-  } while (false)
+  // Run `main` in-process with the ORC JIT.
+  JIT,
+
+  // Compile to a native object file.
+  Object,
+
+  // Compile and link a native executable.
+  Executable,
+
+  // Save the module bitcode to `out.bc`.
+  Bitcode,
+};
+
+/**
+ * Compile-time report format.
+ */
+enum class TimeReport {
+  None,
+  Table,
+  JSON,
+};
+
+/**
+ * Compiler options.
+ */
+struct EvaOptions {
+  ExecMode mode = ExecMode::Emit;
+
+  // Optimization level: 0-3.
+  unsigned optLevel = 0;
+
+  // Report the time of each optimization pass.
+  bool timePasses = false;
+
+  // Native target CPU ("native" for the host CPU) and extra features
+  // ("+avx2,-fma"), used by the Object and Executable modes.
+  std::string cpu;
+  std::string features;
+
+  // Output file, defaults to "out.ll", "out.o", "out" or "out.bc".
+  std::string output;
+
+  // Compilation cache directory, no caching if empty.
+  std::string cacheDir;
+
+  // Native code generation threads (Executable and JIT modes). Parsing,
+  // IR generation and optimization run on one thread.
+  unsigned jobs = 1;
+
+  // Report of the time spent in each phase, printed to stderr.
+  TimeReport timeReport = TimeReport::None;
+};
+
+/**
+ * Special form handler: compiles a `(name ...)` list.
+ */
+using FormHandler = std::function<llvm::Value*(const Exp&)>;
+
+/**
+ * Opcodes of the built-in special forms.
+ */
+enum Opcode : Symbol {
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_GT,
+  OP_LT,
+  OP_EQ,
+  OP_NE,
+  OP_GE,
+  OP_LE,
+  OP_VAR,
+  OP_SET,
+  OP_BEGIN,
+  OP_IF,
+  OP_WHILE,
+  OP_FOR,
+  OP_DEF,
+  OP_ARRAY,
+  OP_NEW_ARRAY,
+  OP_DELETE_ARRAY,
+  OP_GET,
+  OP_PUT,
+  OP_LEN,
+  OP_VADD,
+  OP_VSUB,
+  OP_VMUL,
+  OP_VDIV,
+  OP_VSUM,
+  OP_REGION,
+  OP_ARENA_ARRAY,
+  OP_ASYNC,
+  OP_AWAIT,
+  OP_PIPE,
+  OP_SEND,
+  OP_RECEIVE,
+  OP_COUNT,
+};
+
+/**
+ * Whether the opcode is an arithmetic or a compare operation.
+ */
+inline bool isBinaryOp(Symbol op) { return op <= OP_LE; }
+
+/**
+ * Whether the opcode is a compare operation.
+ */
+inline bool isCompareOp(Symbol op) { return op >= OP_GT && op <= OP_LE; }
+
+/**
+ * Operand of an arithmetic form: a value computed at run time, or a
+ * constant folded from the literals of the AST.
+ */
+struct Operand {
+  // Run-time value, null for a constant.
+  llvm::Value* value = nullptr;
+
+  // Constant: i1, i32, i64 or double, and its value.
+  llvm::Type* type = nullptr;
+  int64_t number = 0;
+  double real = 0;
+};
+
+/**
+ * Heap arrays of a function allocated on its stack instead (see
+ * `EvaLLVM::analyzeEscapes`): the allocation sites, and the variables
+ * holding them.
+ */
+struct StackArrays {
+  std::unordered_set<const Exp*> sites;
+  std::unordered_set<Symbol> vars;
+};
+
+/**
+ * Coroutine of the async function being compiled (see
+ * `EvaLLVM::beginCoroutine`): its id and handle, and the blocks which
+ * destroy and suspend it. Null outside of async functions.
+ *
+ * Also the number of regions open in the function being compiled, which
+ * can't be suspended inside of one.
+ */
+struct Coroutine {
+  llvm::Value* id = nullptr;
+  llvm::Value* handle = nullptr;
+  llvm::BasicBlock* cleanup = nullptr;
+  llvm::BasicBlock* suspend = nullptr;
+  unsigned regions = 0;
+};
+
+/**
+ * Global or function defined by a form of a session, visible to the
+ * next forms (compiled into other modules).
+ */
+struct SessionSymbol {
+  // Symbol name in the JIT, e.g. "x.3" for `x` of the form 3.
+  std::string name;
+
+  // Value type of a global, or the function type.
+  llvm::Type* type = nullptr;
+
+  bool isFunction = false;
+  bool isUnsigned = false;
+};
+
+/**
+ * Changes of the session made by the form being compiled, undone if it
+ * fails: the previous form handlers and session symbols, and whether an
+ * async function was defined before.
+ */
+struct SessionUndo {
+  std::vector<std::pair<Symbol, FormHandler>> forms;
+  std::vector<std::pair<Symbol, std::optional<SessionSymbol>>> symbols;
+  bool asyncDefined = false;
+};
 
 class EvaLLVM {
   public:
-    EvaLLVM() : parser(std::make_unique<EvaParser>()) {
+    EvaLLVM(const EvaOptions& options = {})
+      : options(options),
+        profiler(options.timeReport != TimeReport::None),
+        parser(std::make_unique<EvaParser>()),
+        env(parser->ast.interner()) {
+      parser->timeTokenizer = profiler.enabled;
+      setupSpecialForms();
       moduleInit();
       setupExternFunctions();
       setupGlobalEnvironment();
     }
 
     /**
-     * Executes a program.
+     * Executes a program. Returns the exit code of the program in the JIT
+     * mode, and 0 otherwise.
      */
-    void exec(const std::string& program) {
+    int exec(const std::string& program) {
+      setupTarget();
+
+      // 0. Reuse the compiled module if the program didn't change:
+      if (loadCachedModule(program)) {
+        return run();
+      }
+
       // 1. Parse the program
-      auto ast = parser->parse("(begin " + program + ")");
+      auto text = "(begin " + program + ")";
+      auto ast = parse(text);
       
       // 2. Compile to LLVM IR:
       compile(ast);
 
+      // 3. Optimize:
+      optimize();
+
+      storeCachedModule();
+
+      return run();
+    }
+
+    /**
+     * Executes a program read from a stream, one top-level form at a
+     * time: each form is parsed and compiled before the next one is read,
+     * and its AST is dropped by the next parse. Memory stays bounded by
+     * the largest form (plus the module).
+     *
+     * Streamed programs are not cached.
+     */
+    int exec(std::istream& in) {
+      setupTarget();
+
+      FormReader reader(in);
+      compileForms(reader);
+
+      optimize();
+
+      return run();
+    }
+
+    /**
+     * Executes a program from a source file. The file is mapped to memory
+     * and compiled one top-level form at a time in place: the tokens,
+     * symbols and strings are slices of the mapping, which is kept until
+     * the compiler is destroyed.
+     */
+    int execFile(const std::string& fileName) {
+      setupTarget();
+
+      auto buffer = llvm::MemoryBuffer::getFile(fileName, /* IsText */ false,
+          /* RequiresNullTerminator */ false);
+      if (!buffer) {
+        DIE << "Cannot open \"" << fileName << "\": "
+            << buffer.getError().message() << "\n";
+      }
+
+      source = std::move(*buffer);
+      auto program = std::string_view(source->getBuffer());
+
+      if (loadCachedModule(program)) {
+        return run();
+      }
+
+      parser->ast.borrowStrings(true);
+
+      FormReader reader(program);
+      compileForms(reader);
+
+      optimize();
+
+      storeCachedModule();
+
+      return run();
+    }
+
+    /**
+     * Interactive session (REPL): reads forms from the stream, and runs
+     * each one as soon as it is complete (it may span several lines).
+     * Values of expressions are printed. With `interactive`, prompts
+     * for the input.
+     *
+     * A form which doesn't parse or compile is reported and skipped,
+     * the session goes on.
+     */
+    int repl(std::istream& in, bool interactive) {
+      std::string text;
+      std::string line;
+
+      ErrorLogMessage::recoverable = true;
+
+      for (;;) {
+        if (interactive) {
+          printf("%s", text.empty() ? "eva> " : "...> ");
+          fflush(stdout);
+        }
+
+        if (!std::getline(in, line)) {
+          break;
+        }
+        text += line;
+        text += '\n';
+
+        // Run the complete forms, keep the text of an incomplete one:
+        FormReader reader{std::string_view(text)};
+        std::string_view form;
+        size_t consumed = 0;
+
+        for (;;) {
+          if (!reader.next(form)) {
+            consumed = text.size();
+            break;
+          }
+          if (!reader.complete()) {
+            break;
+          }
+
+          try {
+            evalForm(form);
+          } catch (const EvaError& error) {
+            std::string_view message = error.what();
+            std::cerr << "Error: " << message
+                      << (message.empty() || message.back() != '\n' ? "\n"
+                                                                     : "");
+          } catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+          } catch (...) {
+            // Syntax errors are reported by the parser.
+          }
+
+          consumed = form.data() + form.size() - text.data();
+        }
+
+        text.erase(0, consumed);
+        if (text.find_first_not_of(" \t\r\n") == std::string::npos) {
+          text.clear();
+        }
+      }
+
+      ErrorLogMessage::recoverable = false;
+
+      if (interactive) {
+        printf("\n");
+      }
+      return 0;
+    }
+
+    /**
+     * Compiles a form of the session into its own module, adds it to
+     * the session JIT and runs it.
+     *
+     * Top-level `var`s are globals, and functions are external: later
+     * forms declare the ones they use, and the JIT links them to the
+     * definitions of the previous modules. A redefinition is a new
+     * symbol, forms compiled before it keep the old one.
+     *
+     * If the form fails to compile, the session is left as before it
+     * (its scopes, symbols and module are dropped), and the error is
+     * rethrown.
+     */
+    void evalForm(std::string_view form) {
+      if (!sessionJit_) {
+        startSession();
+      }
+
+      auto ast = parse(form);
+
+      auto depth = env.depth();
+      sessionUndo_ = {};
+      sessionUndo_.asyncDefined = asyncDefined_;
+
+      try {
+        runSessionForm(ast);
+      } catch (...) {
+        undoSessionForm(depth);
+        throw;
+      }
+    }
+
+    /**
+     * Compiles and runs a parsed form of the session.
+     */
+    void runSessionForm(const Exp& ast) {
+      auto name = "eva.form." + std::to_string(sessionForms_);
+      module = std::make_unique<llvm::Module>(name,
+                                              *sessionContext_.getContext());
+      unsigned_.clear();
+      strings_.clear();
+
+      // Bindings of the form (including the declarations of the
+      // previous forms symbols) are dropped at the end of it:
+      env.enterScope();
+
+      fn = createFunction(name, llvm::FunctionType::get(builder->getVoidTy(),
+                                                        /* vararg */ false));
+      {
+        auto timer = profiler.time(Phase::Gen);
+        stackArrays_ = analyzeEscapes(ast);
+        auto value = isVarForm(ast) ? genVar(ast, /* isGlobal */ true)
+                                    : gen(ast);
+        runEventLoop();
+        flushOutput();
+        if (isSessionExpression(ast)) {
+          printValue(value);
+        }
+      }
+      builder->CreateRetVoid();
+
+      env.exitScope();
+
+      optimize();
+
+      auto jitTimer = profiler.time(Phase::JIT);
+      sessionJit_->addModule(std::move(module), sessionContext_);
+      auto formFn = sessionJit_->lookup<void (*)()>(name);
+      jitTimer.stop();
+
+      sessionForms_++;
+
+      auto timer = profiler.time(Phase::Run);
+      formFn();
+      fflush(stdout);
+    }
+
+    /**
+     * Undoes the changes of a failed form, the scopes opened after the
+     * `depth` are exited. The form number is still taken, its symbols
+     * may be in the JIT.
+     */
+    void undoSessionForm(size_t depth) {
+      env.exitScopes(depth);
+
+      for (auto i = sessionUndo_.forms.rbegin(); i != sessionUndo_.forms.rend();
+           i++) {
+        forms_[i->first] = std::move(i->second);
+      }
+      for (auto i = sessionUndo_.symbols.rbegin();
+           i != sessionUndo_.symbols.rend(); i++) {
+        if (i->second) {
+          sessionSymbols_[i->first] = std::move(*i->second);
+        } else {
+          sessionSymbols_.erase(i->first);
+        }
+      }
+      asyncDefined_ = sessionUndo_.asyncDefined;
+      sessionUndo_ = {};
+
+      module.reset();
+      fn = nullptr;
+      coro_ = {};
+      sessionForms_++;
+    }
+
+    /**
+     * Registers a special form: `handler` compiles the `(name ...)`
+     * lists. Registering an existing name replaces its handler.
+     */
+    void registerForm(std::string_view name, FormHandler handler) {
+      auto op = parser->ast.interner().intern(name);
+      if (op >= forms_.size()) {
+        forms_.resize(op + 1);
+      }
+      if (sessionJit_) {
+        sessionUndo_.forms.emplace_back(op, forms_[op]);
+      }
+      forms_[op] = std::move(handler);
+    }
+
+    /**
+     * Declares an external function, callable as `(name args...)`.
+     */
+    void registerExtern(std::string_view name, llvm::FunctionType* fnType) {
+      // Declared in the module of the call (each form of a session has
+      // its own module):
+      registerForm(name, [this, name = std::string(name), fnType](
+                             const Exp& exp) {
+        return genCall(module->getOrInsertFunction(name, fnType), exp);
+      });
+    }
+
+  protected:
+    /**
+     * Runs or saves the compiled module, and prints the time report.
+     */
+    int run() {
+      auto result = runModule();
+
+      switch (options.timeReport) {
+        case TimeReport::Table:
+          profiler.printTable(llvm::errs());
+          break;
+        case TimeReport::JSON:
+          profiler.printJSON(llvm::errs());
+          break;
+        case TimeReport::None:
+          break;
+      }
+
+      return result;
+    }
+
+    /**
+     * Runs or saves the compiled module according to the mode.
+     */
+    int runModule() {
+      if (options.mode == ExecMode::JIT) {
+        return runJIT();
+      }
+
+      auto timer = profiler.time(Phase::Emit);
+
+      switch (options.mode) {
+        // Compile to native code:
+        case ExecMode::Object:
+          target->emitObject(*module, getOutput("out.o"));
+          return 0;
+
+        case ExecMode::Executable: {
+          auto executable = getOutput("out");
+          std::vector<std::string> objectFiles;
+
+          if (options.jobs > 1) {
+            // Functions are compiled in parallel, into one object each job.
+            for (unsigned i = 0; i < options.jobs; i++) {
+              objectFiles.push_back(executable + "." + std::to_string(i) + ".o");
+            }
+            target->emitObjects(*module, objectFiles);
+          } else {
+            objectFiles.push_back(executable + ".o");
+            target->emitObject(*module, objectFiles[0]);
+          }
+
+          EvaTarget::link(objectFiles, executable);
+
+          for (auto& objectFile : objectFiles) {
+            llvm::sys::fs::remove(objectFile);
+          }
+          return 0;
+        }
+
+        // Save module bitcode to file:
+        case ExecMode::Bitcode:
+          saveModuleToBitcodeFile(getOutput("out.bc"));
+          return 0;
+
+        case ExecMode::JIT:
+        case ExecMode::Emit:
+          break;
+      }
+
       // Print generated code.
       module->print(llvm::outs(), nullptr);
 
       std::cout << "\n";
       
-      // 3. Save module IR to file:
-      saveModuleToFile("out.ll");
+      // Save module IR to file:
+      saveModuleToFile(getOutput("out.ll"));
+      return 0;
+    }
+
+    /**
+     * Loads the compiled module from the cache, if the cache is enabled
+     * and has it.
+     */
+    bool loadCachedModule(std::string_view program) {
+      if (options.cacheDir.empty()) {
+        return false;
+      }
+
+      cache = std::make_unique<EvaCache>(options.cacheDir);
+      cacheKey = EvaCache::key(program, getOptionsFingerprint());
+
+      if (auto cached = cache->load(cacheKey, *ctx)) {
+        module = std::move(cached);
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     * Stores the compiled module to the cache, if enabled.
+     */
+    void storeCachedModule() {
+      if (cache) {
+        cache->store(cacheKey, *module);
+      }
+    }
+
+    /**
+     * Options which change the compiled module, part of the cache key:
+     * with no target (JIT), the host CPU and its features (the vector
+     * width of the elementwise forms depends on them).
+     */
+    std::string getOptionsFingerprint() {
+      auto fingerprint = "O" + std::to_string(options.optLevel);
+
+      if (target) {
+        auto targetMachine = target->getTargetMachine();
+        fingerprint += ";" + targetMachine->getTargetTriple().str() + ";" +
+                       targetMachine->getTargetCPU().str() + ";" +
+                       targetMachine->getTargetFeatureString().str();
+        return fingerprint;
+      }
+
+      fingerprint += ";" + llvm::sys::getProcessTriple() + ";" +
+                     llvm::sys::getHostCPUName().str() + ";";
+
+      llvm::StringMap<bool> features;
+      llvm::sys::getHostCPUFeatures(features);
+
+      std::vector<std::string> enabled;
+      for (const auto& feature : features) {
+        if (feature.getValue()) {
+          enabled.push_back("+" + feature.getKey().str());
+        }
+      }
+      std::sort(enabled.begin(), enabled.end());
+      for (const auto& feature : enabled) {
+        fingerprint += feature;
+      }
+      return fingerprint;
+    }
+
+    /**
+     * Sets up the native target for the Object and Executable modes.
+     */
+    void setupTarget() {
+      if (options.mode == ExecMode::Object ||
+          options.mode == ExecMode::Executable) {
+        target = std::make_unique<EvaTarget>(options.cpu, options.features,
+                                             options.optLevel);
+      }
     }
 
-  private:
     /**
      * Compiles an expression.
      */
     void compile(const Exp& ast) {
       // 1. Create main function:
-      fn = createFunction(
-         "main", 
-         llvm::FunctionType::get(/* return type */ builder->getInt32Ty(),
-                                 /* vararg */ false), 
-         GlobalEnv);
+      beginMain();
 
       // createGlobalVar("VERSION", builder->getInt32(42));
 
       // 2. Compile main body:
-      auto result = gen(ast, GlobalEnv);
+      {
+        auto timer = profiler.time(Phase::Gen);
+        stackArrays_ = analyzeEscapes(ast);
+        gen(ast);
+      }
+
+      endMain();
+    }
+
+    /**
+     * Creates the main function, the program is compiled into its body.
+     */
+    void beginMain() {
+      fn = createFunction(
+         "main", 
+         llvm::FunctionType::get(/* return type */ builder->getInt32Ty(),
+                                 /* vararg */ false));
+    }
 
+    /**
+     * Completes the main function.
+     */
+    void endMain() {
+      runEventLoop();
+      flushOutput();
       builder->CreateRet(builder->getInt32(0));
     }
 
+    /**
+     * Compiles the top-level forms into the main function.
+     */
+    void compileForms(FormReader& reader) {
+      beginMain();
+
+      // Top-level forms share one scope, as in `(begin ...)`:
+      env.enterScope();
+
+      std::string_view form;
+
+      while (reader.next(form)) {
+        auto ast = parse(form);
+
+        auto timer = profiler.time(Phase::Gen);
+        stackArrays_ = analyzeEscapes(ast);
+        gen(ast);
+      }
+
+      env.exitScope();
+
+      endMain();
+    }
+
+    /**
+     * Parses a program or a form, profiling the tokenizer and the parser.
+     */
+    Exp parse(std::string_view text) {
+      auto start = EvaProfiler::Clock::now();
+
+      Exp ast;
+      parsedText_ = text;
+      try {
+        ast = parser->parse(text);
+      } catch (const syntax::ValueError& error) {
+        auto [line, column] = getSourceLocation(text, error.line, error.column);
+        DIE << error.what() << " (at " << line << ":" << column << ")\n";
+      }
+
+      if (profiler.enabled) {
+        auto elapsed = EvaProfiler::Clock::now() - start;
+        profiler.add(Phase::Tokenize, parser->tokenizerTime);
+        profiler.add(Phase::Parse, elapsed - parser->tokenizerTime);
+      }
+
+      profiler.tokens += parser->tokensCount;
+      profiler.astNodes += parser->ast.size() + 1;
+      return ast;
+    }
+
+    /**
+     * Location in the source file of a location in the `text` parsed (a
+     * form of the mapped file), or the same one.
+     */
+    std::pair<int, int> getSourceLocation(std::string_view text, int line,
+                                          int column) {
+      if (!source) {
+        return {line, column};
+      }
+
+      auto file = std::string_view(source->getBuffer());
+      if (text.data() < file.data() ||
+          text.data() > file.data() + file.size()) {
+        return {line, column};
+      }
+
+      auto before = file.substr(0, text.data() - file.data());
+
+      // The first line of the form may start after the line start:
+      if (line == 1) {
+        auto lineStart = before.rfind('\n');
+        column += before.size() -
+                  (lineStart == std::string_view::npos ? 0 : lineStart + 1);
+      }
+      line += std::count(before.begin(), before.end(), '\n');
+      return {line, column};
+    }
+
+    /**
+     * Source location of a list form, for error messages: " (at 3:8)".
+     */
+    std::string getLocation(const Exp& exp) {
+      auto before = parsedText_.substr(0, exp.offset);
+      auto lineStart = before.rfind('\n');
+
+      int line = std::count(before.begin(), before.end(), '\n') + 1;
+      int column = before.size() -
+                   (lineStart == std::string_view::npos ? 0 : lineStart + 1);
+      std::tie(line, column) = getSourceLocation(parsedText_, line, column);
+
+      return " (at " + std::to_string(line) + ":" + std::to_string(column) +
+             ")";
+    }
+
     /** 
      * Main compile loop.
      */
-    llvm::Value* gen(const Exp& exp, Env env) {
+    llvm::Value* gen(const Exp& exp) {
 
       switch (exp.type) {
         /**
@@ -88,7 +814,8 @@ class EvaLLVM {
          * Numbers.
          */
         case ExpType::NUMBER:
-          return builder->getInt32(exp.number);
+        case ExpType::FLOAT:
+          return materialize(genOperand(exp));
 
         /**
          * ---------------------------------------
@@ -102,176 +829,2179 @@ class EvaLLVM {
             return builder->getInt1(exp.string == "true" ? true : false);
           } else {
             // Variables:
-            auto varName = exp.string;
-            auto value = env->lookup(varName);
-            
-            // 1. Local vars: (TODO)
-            if (auto localVar = llvm::dyn_cast<llvm::AllocaInst>(value)) {
-              return builder->CreateLoad(localVar->getAllocatedType(), localVar,
-                  varName.c_str());
+            auto varName = llvm::StringRef(exp.string);
+            auto value = lookupVar(exp.symbol);
+
+            // Local (alloca) and global vars:
+            if (llvm::isa<llvm::AllocaInst>(value) ||
+                llvm::isa<llvm::GlobalVariable>(value)) {
+              auto load = builder->CreateLoad(getVarType(value), value,
+                  varName);
+              if (isUnsigned(value)) {
+                unsigned_.insert(load);
+              }
+              return load;
             }
 
-            // 2. Global vars:
-            else if (auto globalVar = llvm::dyn_cast<llvm::GlobalVariable>(value)) {
-              return builder->CreateLoad(globalVar->getInitializer()->getType(), globalVar,
-                  varName.c_str());
-            }
-          }
-        /**
-         * ---------------------------------------
-         * Strings.
-         */
-        case ExpType::STRING: {
-          // Unescape special chars. TODO: support all chars or handle in parser.
-          auto re = std::regex("\\\\n");
-          auto str = std::regex_replace(exp.string, re, "\n");
+            // Functions:
+            return value;
+          }
+        /**
+         * ---------------------------------------
+         * Strings.
+         */
+        case ExpType::STRING:
+          // Escapes are decoded by the parser.
+          return getStringPtr(exp.symbol);
+
+        /**
+         * ---------------------------------------
+         * Lists.
+         */
+        case ExpType::LIST: {
+          if (exp.list.size() == 0) {
+            DIE << "An empty list is not an expression.";
+          }
+          const auto& tag = exp.list[0];
+
+          /**
+           * -------------------------------------
+           * Special forms: dispatched by the interned symbol.
+           */
+          if (tag.type == ExpType::SYMBOL && tag.symbol < forms_.size() &&
+              forms_[tag.symbol]) {
+            return forms_[tag.symbol](exp);
+          }
+
+          // Functions are called after their definition:
+          if (tag.type == ExpType::SYMBOL) {
+            DIE << "Function \"" << tag.string << "\" is not defined.";
+          }
+          DIE << "A list should start with a form or a function name.";
+        }
+      }
+      // Unreachable
+      return builder->getInt32(0);
+    }
+
+    /**
+     * Sets up the built-in special forms.
+     *
+     * The names are interned in the `Opcode` order before anything else,
+     * so the symbol of a built-in form is its opcode.
+     */
+    void setupSpecialForms() {
+      // -----------------------------------
+      // Binary math and compare operations: (+ x 10), (> x 10)
+
+      for (auto op : {"+", "-", "*", "/", ">", "<", "==", "!=", ">=", "<="}) {
+        registerForm(op, [this](const Exp& exp) {
+          return materialize(genBinary(exp));
+        });
+      }
+
+      // -----------------------------------
+      // Variables and blocks:
+
+      registerForm("var", [this](const Exp& exp) { return genVar(exp); });
+      registerForm("set", [this](const Exp& exp) { return genSet(exp); });
+      registerForm("begin", [this](const Exp& exp) { return genBegin(exp); });
+
+      // -----------------------------------
+      // Control flow:
+
+      registerForm("if", [this](const Exp& exp) { return genIf(exp); });
+      registerForm("while", [this](const Exp& exp) { return genWhile(exp); });
+      registerForm("for", [this](const Exp& exp) { return genFor(exp); });
+
+      // -----------------------------------
+      // Functions:
+
+      registerForm("def", [this](const Exp& exp) { return genDef(exp); });
+
+      // -----------------------------------
+      // Arrays:
+
+      registerForm("array", [this](const Exp& exp) { return genArray(exp); });
+      registerForm("new-array",
+                   [this](const Exp& exp) { return genNewArray(exp); });
+      registerForm("delete-array",
+                   [this](const Exp& exp) { return genDeleteArray(exp); });
+      registerForm("get", [this](const Exp& exp) { return genGet(exp); });
+      registerForm("put", [this](const Exp& exp) { return genPut(exp); });
+      registerForm("len", [this](const Exp& exp) {
+        return arrayLength(genArrayOperand(exp, 1));
+      });
+
+      // Elementwise: (vadd a b) is a[i] = a[i] + b[i]
+      for (auto op : {OP_ADD, OP_SUB, OP_MUL, OP_DIV}) {
+        registerForm(vectorOpNames_[op], [this, op](const Exp& exp) {
+          return genElementwise(exp, op);
+        });
+      }
+      registerForm("vsum", [this](const Exp& exp) { return genVsum(exp); });
+
+      // -----------------------------------
+      // Arena heap:
+
+      registerForm("region", [this](const Exp& exp) { return genRegion(exp); });
+      registerForm("arena-array",
+                   [this](const Exp& exp) { return genArenaArray(exp); });
+
+      // -----------------------------------
+      // Async functions and events:
+
+      registerForm("async", [this](const Exp& exp) {
+        return genDef(exp, /* isAsync */ true);
+      });
+      registerForm("await", [this](const Exp& exp) { return genAwait(exp); });
+      registerForm("pipe", [this](const Exp& exp) { return genPipe(exp); });
+      registerForm("send", [this](const Exp& exp) { return genSend(exp); });
+      registerForm("receive",
+                   [this](const Exp& exp) { return genReceive(exp); });
+
+      assert(forms_.size() == OP_COUNT);
+    }
+
+    /**
+     * Variable declaration: (var x (+ y 10))
+     *
+     * Typed: (var (x float) 42), the initializer is converted to the
+     * type. Untyped variables have the type of the initializer.
+     *
+     * Note: locals are allocated on the stack, top-level variables of a
+     * session (`isGlobal`) are globals.
+     */
+    llvm::Value* genVar(const Exp& exp, bool isGlobal = false) {
+      const auto& varNameDecl = exp.list[1];
+      auto varName = extractVarName(varNameDecl);
+
+      // Initializer:
+      auto init = gen(exp.list[2]);
+
+      // Type:
+      auto isTyped = varNameDecl.type == ExpType::LIST;
+      auto varTy = isTyped ? extractVarType(varNameDecl) : init->getType();
+      auto varUnsigned = isTyped ? isUnsignedType(varNameDecl.list[1].string)
+                                 : isUnsigned(init);
+
+      // Vardiable:
+      auto varBinding = isGlobal
+                            ? allocSessionVar(varName, varTy, varUnsigned)
+                            : allocVar(varName, varTy, varUnsigned);
+
+      // Set value:
+      return builder->CreateStore(convert(init, varTy, varUnsigned),
+                                  varBinding);
+    }
+
+    /**
+     * Variable update: (set x 100)
+     */
+    llvm::Value* genSet(const Exp& exp) {
+      auto value = gen(exp.list[2]);
+
+      auto varName = exp.list[1].symbol;
+
+      // Variable:
+      auto varBinding = lookupVar(varName);
+
+      // Set value:
+      return builder->CreateStore(
+          convert(value, getVarType(varBinding), isUnsigned(varBinding)),
+          varBinding);
+    }
+
+    /**
+     * Returns the binding of a variable in the current function: locals
+     * of other functions are not accessible (functions don't capture).
+     */
+    llvm::Value* lookupVar(Symbol name) {
+      auto value = env.find(name);
+
+      // Globals and functions of the previous forms of a session:
+      if (value == nullptr && sessionJit_) {
+        value = declareSessionSymbol(name);
+      }
+
+      if (value == nullptr) {
+        DIE << "Variable \"" << parser->ast.interner().name(name)
+            << "\" is not defined.";
+      }
+
+      if (auto inst = llvm::dyn_cast<llvm::Instruction>(value)) {
+        if (inst->getFunction() != fn) {
+          DIE << "Variable \"" << parser->ast.interner().name(name)
+              << "\" is not accessible in function \""
+              << fn->getName().str() << "\".";
+        }
+      }
+      return value;
+    }
+
+    /**
+     * Arithmetic and compare operations: (+ x 10), (> x 10)
+     *
+     * Operands of different types are promoted as in C: to double if
+     * either is floating point, otherwise to the wider integer. Integers
+     * are signed, unless one of the operands is unsigned.
+     *
+     * Operations on constants are folded on the AST: (+ 32 10) is the
+     * constant 42, without any IR built for the operands.
+     */
+    Operand genBinary(const Exp& exp) {
+      auto op = exp.list[0].symbol;
+      if (exp.list.size() != 3) {
+        DIE << "\"" << exp.list[0].string << "\" expects 2 operands, got "
+            << exp.list.size() - 1 << "." << getLocation(exp) << "\n";
+      }
+
+      auto lhs = genOperand(exp.list[1]);
+      auto rhs = genOperand(exp.list[2]);
+      checkScalarOperand(exp, lhs);
+      checkScalarOperand(exp, rhs);
+
+      Operand result;
+      if (lhs.value == nullptr && rhs.value == nullptr &&
+          fold(op, lhs, rhs, result)) {
+        return result;
+      }
+
+      result.value = emitBinary(op, materialize(lhs), materialize(rhs));
+      return result;
+    }
+
+    /**
+     * Arithmetic and compare operands are numbers or booleans, not
+     * strings, arrays or records.
+     */
+    void checkScalarOperand(const Exp& exp, const Operand& operand) {
+      if (operand.value == nullptr) {
+        return;
+      }
+      auto type = operand.value->getType();
+      if (!type->isIntegerTy() && !type->isDoubleTy()) {
+        DIE << "\"" << exp.list[0].string << "\": number expected, got "
+            << typeName(type) << "." << getLocation(exp) << "\n";
+      }
+    }
+
+    /**
+     * Operand of an arithmetic form: number literals and nested
+     * arithmetic are kept as constants while they can be folded.
+     */
+    Operand genOperand(const Exp& exp) {
+      Operand operand;
+
+      switch (exp.type) {
+        // Integers are i32, or i64 if they don't fit:
+        case ExpType::NUMBER:
+          operand.type = exp.number == (int32_t)exp.number
+                             ? builder->getInt32Ty()
+                             : builder->getInt64Ty();
+          operand.number = exp.number;
+          return operand;
+
+        case ExpType::FLOAT:
+          operand.type = builder->getDoubleTy();
+          operand.real = exp.real;
+          return operand;
+
+        case ExpType::LIST:
+          if (exp.list.size() == 3 && exp.list[0].type == ExpType::SYMBOL &&
+              isBinaryOp(exp.list[0].symbol)) {
+            return genBinary(exp);
+          }
+          break;
+
+        default:
+          break;
+      }
+
+      operand.value = gen(exp);
+      return operand;
+    }
+
+    /**
+     * Folds an operation on constants. Returns false if it can't be
+     * folded (division by zero, or overflow): it's left for run time.
+     */
+    bool fold(Symbol op, const Operand& lhs, const Operand& rhs,
+              Operand& result) {
+      auto type = promote(lhs.type, rhs.type);
+
+      // Floating point:
+      if (type->isDoubleTy()) {
+        auto x = lhs.type->isDoubleTy() ? lhs.real : (double)lhs.number;
+        auto y = rhs.type->isDoubleTy() ? rhs.real : (double)rhs.number;
+
+        result.type = type;
+        switch (op) {
+          case OP_ADD: result.real = x + y; return true;
+          case OP_SUB: result.real = x - y; return true;
+          case OP_MUL: result.real = x * y; return true;
+          case OP_DIV: result.real = x / y; return true;
+        }
+
+        result.type = builder->getInt1Ty();
+        result.number = compare(op, x, y);
+        return true;
+      }
+
+      // Integers, kept sign-extended to 64 bits:
+      auto x = lhs.number;
+      auto y = rhs.number;
+      auto bits = type->getIntegerBitWidth();
+
+      result.type = type;
+      switch (op) {
+        case OP_ADD: result.number = wrap((uint64_t)x + y, bits); return true;
+        case OP_SUB: result.number = wrap((uint64_t)x - y, bits); return true;
+        case OP_MUL: result.number = wrap((uint64_t)x * y, bits); return true;
+        case OP_DIV:
+          if (y == 0 || (y == -1 && x == wrap((uint64_t)1 << (bits - 1), bits))) {
+            return false;
+          }
+          result.number = x / y;
+          return true;
+      }
+
+      result.type = builder->getInt1Ty();
+      result.number = compare(op, x, y);
+      return true;
+    }
+
+    /**
+     * Compares folded constants.
+     */
+    template <typename T>
+    static bool compare(Symbol op, T x, T y) {
+      switch (op) {
+        case OP_GT: return x > y;
+        case OP_LT: return x < y;
+        case OP_EQ: return x == y;
+        case OP_NE: return x != y;
+        case OP_GE: return x >= y;
+        default:    return x <= y;
+      }
+    }
+
+    /**
+     * Truncates an integer to `bits`, sign-extending it back to 64 bits
+     * (booleans are 0 or 1).
+     */
+    static int64_t wrap(uint64_t value, unsigned bits) {
+      if (bits == 1) {
+        return value & 1;
+      }
+      return bits >= 64 ? (int64_t)value
+                        : (int64_t)(value << (64 - bits)) >> (64 - bits);
+    }
+
+    /**
+     * Type of a binary operation on the given operand types.
+     */
+    llvm::Type* promote(llvm::Type* lhs, llvm::Type* rhs) {
+      if (lhs == rhs) {
+        return lhs;
+      }
+      if (lhs->isDoubleTy() || rhs->isDoubleTy()) {
+        return builder->getDoubleTy();
+      }
+      return lhs->getIntegerBitWidth() >= rhs->getIntegerBitWidth() ? lhs
+                                                                     : rhs;
+    }
+
+    /**
+     * Emits an operation on run-time values (scalars, or vectors of the
+     * same type).
+     */
+    llvm::Value* emitBinary(Symbol op, llvm::Value* lhs, llvm::Value* rhs) {
+      auto isUnsignedOp = isUnsigned(lhs) || isUnsigned(rhs);
+
+      auto type = promote(lhs->getType(), rhs->getType());
+      lhs = convert(lhs, type, isUnsignedOp);
+      rhs = convert(rhs, type, isUnsignedOp);
+
+      llvm::Value* result;
+
+      // Floating point (also vectors of it, see genElementwise):
+      if (type->isFPOrFPVectorTy()) {
+        switch (op) {
+          case OP_ADD: return builder->CreateFAdd(lhs, rhs, "tmpadd");
+          case OP_SUB: return builder->CreateFSub(lhs, rhs, "tmpsub");
+          case OP_MUL: return builder->CreateFMul(lhs, rhs, "tmpmul");
+          case OP_DIV: return builder->CreateFDiv(lhs, rhs, "tmpdiv");
+
+          // As in C: false if either is NaN, but != is true then (the
+          // same as the folded comparisons).
+          case OP_GT: return builder->CreateFCmpOGT(lhs, rhs, "tmpcmp");
+          case OP_LT: return builder->CreateFCmpOLT(lhs, rhs, "tmpcmp");
+          case OP_EQ: return builder->CreateFCmpOEQ(lhs, rhs, "tmpcmp");
+          case OP_NE: return builder->CreateFCmpUNE(lhs, rhs, "tmpcmp");
+          case OP_GE: return builder->CreateFCmpOGE(lhs, rhs, "tmpcmp");
+          default:    return builder->CreateFCmpOLE(lhs, rhs, "tmpcmp");
+        }
+      }
+
+      switch (op) {
+        case OP_ADD: result = builder->CreateAdd(lhs, rhs, "tmpadd"); break;
+        case OP_SUB: result = builder->CreateSub(lhs, rhs, "tmpsub"); break;
+        case OP_MUL: result = builder->CreateMul(lhs, rhs, "tmpmul"); break;
+        case OP_DIV:
+          result = isUnsignedOp ? builder->CreateUDiv(lhs, rhs, "tmpdiv")
+                                : builder->CreateSDiv(lhs, rhs, "tmpdiv");
+          break;
+
+        // Signed (SGT, ...) or unsigned (UGT, ...) compare:
+        case OP_GT:
+          return isUnsignedOp ? builder->CreateICmpUGT(lhs, rhs, "tmpcmp")
+                              : builder->CreateICmpSGT(lhs, rhs, "tmpcmp");
+        case OP_LT:
+          return isUnsignedOp ? builder->CreateICmpULT(lhs, rhs, "tmpcmp")
+                              : builder->CreateICmpSLT(lhs, rhs, "tmpcmp");
+        case OP_EQ: return builder->CreateICmpEQ(lhs, rhs, "tmpcmp");
+        case OP_NE: return builder->CreateICmpNE(lhs, rhs, "tmpcmp");
+        case OP_GE:
+          return isUnsignedOp ? builder->CreateICmpUGE(lhs, rhs, "tmpcmp")
+                              : builder->CreateICmpSGE(lhs, rhs, "tmpcmp");
+        default:
+          return isUnsignedOp ? builder->CreateICmpULE(lhs, rhs, "tmpcmp")
+                              : builder->CreateICmpSLE(lhs, rhs, "tmpcmp");
+      }
+
+      if (isUnsignedOp) {
+        unsigned_.insert(result);
+      }
+      return result;
+    }
+
+    /**
+     * Materializes an operand as an LLVM value.
+     */
+    llvm::Value* materialize(const Operand& operand) {
+      if (operand.value != nullptr) {
+        return operand.value;
+      }
+      if (operand.type->isDoubleTy()) {
+        return llvm::ConstantFP::get(operand.type, operand.real);
+      }
+      return llvm::ConstantInt::get(operand.type, operand.number,
+                                    /* isSigned */ true);
+    }
+
+    /**
+     * Converts a numeric value to the type: integers are truncated or
+     * extended (zero-extended if unsigned), and converted to and from
+     * floating point.
+     */
+    llvm::Value* convert(llvm::Value* value, llvm::Type* type,
+                         bool isUnsignedType) {
+      auto from = value->getType();
+      if (from == type) {
+        return value;
+      }
+
+      // Booleans are 0 or 1.
+      auto isUnsignedValue = isUnsigned(value) || from->isIntegerTy(1);
+
+      if (from->isIntegerTy() && type->isIntegerTy()) {
+        return builder->CreateIntCast(value, type, !isUnsignedValue);
+      }
+      if (from->isIntegerTy() && type->isFloatingPointTy()) {
+        return isUnsignedValue ? builder->CreateUIToFP(value, type)
+                               : builder->CreateSIToFP(value, type);
+      }
+      if (from->isFloatingPointTy() && type->isIntegerTy()) {
+        return isUnsignedType ? builder->CreateFPToUI(value, type)
+                              : builder->CreateFPToSI(value, type);
+      }
+      if (from->isFloatingPointTy() && type->isFloatingPointTy()) {
+        return builder->CreateFPCast(value, type);
+      }
+
+      DIE << "Cannot convert " << typeName(from) << " to " << typeName(type)
+          << ".";
+      return value;
+    }
+
+    /**
+     * Whether the value is an unsigned integer (or an unsigned variable).
+     */
+    bool isUnsigned(llvm::Value* value) { return unsigned_.count(value) != 0; }
+
+    /**
+     * Type of the variable value.
+     */
+    static llvm::Type* getVarType(llvm::Value* varBinding) {
+      if (auto localVar = llvm::dyn_cast<llvm::AllocaInst>(varBinding)) {
+        return localVar->getAllocatedType();
+      }
+      return llvm::cast<llvm::GlobalVariable>(varBinding)->getValueType();
+    }
+
+    /**
+     * Type name for error messages: i32, double, ...
+     */
+    static std::string typeName(llvm::Type* type) {
+      // Named structs (arrays, records) by their name only:
+      if (auto structType = llvm::dyn_cast<llvm::StructType>(type)) {
+        if (structType->hasName()) {
+          return structType->getName().str();
+        }
+      }
+
+      std::string name;
+      llvm::raw_string_ostream out(name);
+      type->print(out);
+      return out.str();
+    }
+
+    /**
+     * Blocks: (begin <expression>)
+     */
+    llvm::Value* genBegin(const Exp& exp) {
+      // Block scope:
+      env.enterScope();
+
+      // Compile each expression within the block
+      // Result is the last evaluated expression
+      llvm::Value* blockRes;
+      for (size_t i = 1; i < exp.list.size(); i++) {
+        //Generate expression code
+        blockRes = gen(exp.list[i]);
+      }
+
+      env.exitScope();
+      return blockRes;
+    }
+
+    /**
+     * Branches: (if <condition> <consequent> <alternate>)
+     *
+     * The alternate is optional. The result is the value of the taken
+     * branch, merged with a phi node (numbers are promoted to a common
+     * type), or 0 if the branches have no common type.
+     */
+    llvm::Value* genIf(const Exp& exp) {
+      // Condition:
+      auto cond = toBool(gen(exp.list[1]));
+
+      // Then block: appended right away to render the condition,
+      // else and ifend blocks are appended later.
+      auto thenBlock = createBB("then", fn);
+      auto elseBlock = createBB("else");
+      auto ifEndBlock = createBB("ifend");
+
+      builder->CreateCondBr(cond, thenBlock, elseBlock);
+
+      // Then branch (may create nested blocks, the phi is taken from
+      // the one it ends in):
+      builder->SetInsertPoint(thenBlock);
+      auto thenRes = gen(exp.list[2]);
+      auto thenEnd = builder->GetInsertBlock();
+
+      // Else branch:
+      fn->getBasicBlockList().push_back(elseBlock);
+      builder->SetInsertPoint(elseBlock);
+      auto elseRes = exp.list.size() > 3 ? gen(exp.list[3]) : nullptr;
+      auto elseEnd = builder->GetInsertBlock();
+
+      // Both branches jump to ifend, with the values converted
+      // to the merged type:
+      auto type = getMergeType(thenRes, elseRes);
+      auto isUnsignedRes = type != nullptr &&
+                           (isUnsigned(thenRes) || isUnsigned(elseRes));
+
+      builder->SetInsertPoint(thenEnd);
+      if (type != nullptr) {
+        thenRes = convert(thenRes, type, isUnsignedRes);
+      }
+      builder->CreateBr(ifEndBlock);
+
+      builder->SetInsertPoint(elseEnd);
+      if (type != nullptr) {
+        elseRes = convert(elseRes, type, isUnsignedRes);
+      }
+      builder->CreateBr(ifEndBlock);
+
+      fn->getBasicBlockList().push_back(ifEndBlock);
+      builder->SetInsertPoint(ifEndBlock);
+
+      if (type == nullptr) {
+        return builder->getInt32(0);
+      }
+
+      // Result of the if expression is phi:
+      auto phi = builder->CreatePHI(type, 2, "tmpif");
+      phi->addIncoming(thenRes, thenEnd);
+      phi->addIncoming(elseRes, elseEnd);
+
+      if (isUnsignedRes) {
+        unsigned_.insert(phi);
+      }
+      return phi;
+    }
+
+    /**
+     * Loops: (while <condition> <body>)
+     *
+     * The result is 0.
+     */
+    llvm::Value* genWhile(const Exp& exp) {
+      // Condition:
+      auto condBlock = createBB("cond", fn);
+      builder->CreateBr(condBlock);
+
+      // Body, while end blocks:
+      auto bodyBlock = createBB("body");
+      auto loopEndBlock = createBB("loopend");
+
+      builder->SetInsertPoint(condBlock);
+      auto cond = toBool(gen(exp.list[1]));
+      builder->CreateCondBr(cond, bodyBlock, loopEndBlock);
+
+      // Body:
+      fn->getBasicBlockList().push_back(bodyBlock);
+      builder->SetInsertPoint(bodyBlock);
+      gen(exp.list[2]);
+      builder->CreateBr(condBlock);
+
+      fn->getBasicBlockList().push_back(loopEndBlock);
+      builder->SetInsertPoint(loopEndBlock);
+
+      return builder->getInt32(0);
+    }
+
+    /**
+     * Loops: (for <init> <condition> <step> <body>)
+     *
+     *   (for (var i 0) (< i 10) (set i (+ i 1)) (printf "%d" i))
+     *
+     * The init variable is scoped to the loop. An induction variable
+     * (declared by the init, updated only by the step) lives in
+     * a register: it's a phi node of the condition block, rather than
+     * a stack slot loaded and stored on each iteration. The result is 0.
+     */
+    llvm::Value* genFor(const Exp& exp) {
+      const auto& init = exp.list[1];
+      const auto& step = exp.list[3];
+      const auto& body = exp.list[4];
+
+      env.enterScope();
+
+      // Induction variable:
+      llvm::PHINode* inductionVar = nullptr;
+
+      if (isVarForm(init) && isSetForm(step) &&
+          step.list[1].symbol == extractVarName(init.list[1]) &&
+          !assigns(body, step.list[1].symbol)) {
+        const auto& varNameDecl = init.list[1];
+        auto isTyped = varNameDecl.type == ExpType::LIST;
+
+        auto initValue = gen(init.list[2]);
+        auto varTy = isTyped ? extractVarType(varNameDecl)
+                             : initValue->getType();
+        auto varUnsigned = isTyped
+                               ? isUnsignedType(varNameDecl.list[1].string)
+                               : isUnsigned(initValue);
+        initValue = convert(initValue, varTy, varUnsigned);
+
+        auto preheader = builder->GetInsertBlock();
+        auto condBlock = createBB("forcond", fn);
+        builder->CreateBr(condBlock);
+        builder->SetInsertPoint(condBlock);
+
+        auto varName = extractVarName(varNameDecl);
+        inductionVar = builder->CreatePHI(
+            varTy, 2, llvm::StringRef(parser->ast.interner().name(varName)));
+        inductionVar->addIncoming(initValue, preheader);
+
+        if (varUnsigned) {
+          unsigned_.insert(inductionVar);
+        }
+        env.define(varName, inductionVar);
+      }
+
+      // Any other init is compiled before the loop:
+      else {
+        gen(init);
+
+        auto condBlock = createBB("forcond", fn);
+        builder->CreateBr(condBlock);
+        builder->SetInsertPoint(condBlock);
+      }
+
+      auto condBlock = builder->GetInsertBlock();
+      auto bodyBlock = createBB("forbody");
+      auto loopEndBlock = createBB("forend");
+
+      // Condition:
+      auto cond = toBool(gen(exp.list[2]));
+      builder->CreateCondBr(cond, bodyBlock, loopEndBlock);
+
+      // Body:
+      fn->getBasicBlockList().push_back(bodyBlock);
+      builder->SetInsertPoint(bodyBlock);
+      gen(body);
+
+      // Step: the next value of the induction variable, or any
+      // expression:
+      if (inductionVar != nullptr) {
+        auto next = convert(gen(step.list[2]), inductionVar->getType(),
+                            isUnsigned(inductionVar));
+        inductionVar->addIncoming(next, builder->GetInsertBlock());
+      } else {
+        gen(step);
+      }
+      builder->CreateBr(condBlock);
+
+      fn->getBasicBlockList().push_back(loopEndBlock);
+      builder->SetInsertPoint(loopEndBlock);
+
+      env.exitScope();
+      return builder->getInt32(0);
+    }
+
+    /**
+     * Converts a condition to i1: numbers are compared with 0 (a NaN is
+     * true, as in C).
+     */
+    llvm::Value* toBool(llvm::Value* value) {
+      auto type = value->getType();
+
+      if (type->isIntegerTy(1)) {
+        return value;
+      }
+      if (type->isFloatingPointTy()) {
+        return builder->CreateFCmpUNE(
+            value, llvm::ConstantFP::get(type, 0.0), "tmpcond");
+      }
+      return builder->CreateICmpNE(value, llvm::ConstantInt::get(type, 0),
+                                   "tmpcond");
+    }
+
+    /**
+     * Type of the merged branch values: the same type, or the promoted
+     * numeric type. Null if they can't be merged.
+     */
+    llvm::Type* getMergeType(llvm::Value* lhs, llvm::Value* rhs) {
+      if (lhs == nullptr || rhs == nullptr) {
+        return nullptr;
+      }
+
+      auto lhsTy = lhs->getType();
+      auto rhsTy = rhs->getType();
+
+      if (lhsTy == rhsTy) {
+        return lhsTy->isVoidTy() ? nullptr : lhsTy;
+      }
+
+      auto isNumber = [](llvm::Type* type) {
+        return type->isIntegerTy() || type->isDoubleTy();
+      };
+      return isNumber(lhsTy) && isNumber(rhsTy) ? promote(lhsTy, rhsTy)
+                                                : nullptr;
+    }
+
+    /**
+     * Whether the expression is a (var <name> <init>) form.
+     */
+    static bool isVarForm(const Exp& exp) {
+      return exp.type == ExpType::LIST && exp.list.size() == 3 &&
+             exp.list[0].type == ExpType::SYMBOL &&
+             exp.list[0].symbol == OP_VAR;
+    }
+
+    /**
+     * Whether the expression is a (set <name> <value>) form.
+     */
+    static bool isSetForm(const Exp& exp) {
+      return exp.type == ExpType::LIST && exp.list.size() == 3 &&
+             exp.list[0].type == ExpType::SYMBOL &&
+             exp.list[0].symbol == OP_SET &&
+             exp.list[1].type == ExpType::SYMBOL;
+    }
+
+    /**
+     * Whether the expression assigns the variable anywhere: (set <name> ...)
+     */
+    static bool assigns(const Exp& exp, Symbol name) {
+      if (exp.type != ExpType::LIST) {
+        return false;
+      }
+      if (isSetForm(exp) && exp.list[1].symbol == name) {
+        return true;
+      }
+      for (const auto& entry : exp.list) {
+        if (assigns(entry, name)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Extern function call: (printf "Value: %d" 42)
+     */
+    llvm::Value* genCall(llvm::FunctionCallee callee, const Exp& exp) {
+      std::vector<llvm::Value*> args{};
+
+      for (size_t i = 1; i < exp.list.size(); i++) {
+        args.push_back(gen(exp.list[i]));
+      }
+      return builder->CreateCall(callee, args);
+    }
+
+    /**
+     * Formatted output: (printf "x = %d\n" x)
+     *
+     * A literal format is broken down at compile time into typed calls
+     * of the runtime (see EvaRuntime), which write to the output buffer
+     * without parsing the format at run time: text, %d %i %u %s %%, and
+     * the l and ll sizes. Other formats (%f, widths, ...) are passed to
+     * printf, after the buffer is flushed.
+     *
+     * Returns the number of bytes written.
+     */
+    llvm::Value* genPrintf(const Exp& exp) {
+      if (exp.list.size() < 2) {
+        DIE << "printf expects a format.";
+      }
+      const auto& format = exp.list[1];
+
+      // Arguments are evaluated first, in order:
+      auto formatValue = format.type == ExpType::STRING ? nullptr
+                                                         : gen(format);
+      std::vector<llvm::Value*> args;
+      for (size_t i = 2; i < exp.list.size(); i++) {
+        args.push_back(gen(exp.list[i]));
+      }
+
+      std::vector<FormatPiece> pieces;
+      if (formatValue == nullptr && splitFormat(format.string, args, pieces)) {
+        return genFormatPieces(pieces, args);
+      }
+
+      // Run-time format:
+      if (formatValue == nullptr) {
+        formatValue = gen(format);
+      }
+      flushOutput();
+
+      args.insert(args.begin(), formatValue);
+      auto printfFn = module->getOrInsertFunction(
+          "printf", EvaRuntime::getPrintfType(module->getContext()));
+      return builder->CreateCall(printfFn, args);
+    }
+
+    /**
+     * Piece of a printf format: text, or a conversion ('d', 'u', 's')
+     * of the next argument.
+     */
+    struct FormatPiece {
+      std::string_view text;
+      char conversion = 0;
+      bool isLong = false;
+    };
+
+    /**
+     * Splits a printf format into text and conversions of the arguments.
+     * Returns false if the format has other conversions, or they don't
+     * match the arguments.
+     */
+    static bool splitFormat(std::string_view format,
+                            const std::vector<llvm::Value*>& args,
+                            std::vector<FormatPiece>& pieces) {
+      // printf stops at a NUL (e.g. "\x00"):
+      format = format.substr(0, format.find('\0'));
+      size_t arg = 0;
+
+      while (!format.empty()) {
+        auto percent = format.find('%');
+        if (percent != 0) {
+          pieces.push_back({format.substr(0, percent)});
+          format.remove_prefix(std::min(percent, format.size()));
+          continue;
+        }
+
+        // %%
+        if (format.substr(0, 2) == "%%") {
+          pieces.push_back({format.substr(1, 1)});
+          format.remove_prefix(2);
+          continue;
+        }
+
+        // %d, %ld, %lld, ...
+        FormatPiece piece;
+        size_t size = 1;
+        while (size < 3 && format.substr(size, 1) == "l") {
+          piece.isLong = true;
+          size++;
+        }
+        if (size >= format.size() || arg >= args.size()) {
+          return false;
+        }
+
+        auto conversion = format[size];
+        auto type = args[arg++]->getType();
+
+        if (conversion == 'd' || conversion == 'i' || conversion == 'u') {
+          if (!type->isIntegerTy()) {
+            return false;
+          }
+          piece.conversion = conversion == 'u' ? 'u' : 'd';
+        } else if (conversion == 's' && !piece.isLong) {
+          if (!type->isPointerTy()) {
+            return false;
+          }
+          piece.conversion = 's';
+        } else {
+          return false;
+        }
+
+        pieces.push_back(piece);
+        format.remove_prefix(size + 1);
+      }
+
+      return arg == args.size();
+    }
+
+    /**
+     * Prints the pieces of a format with the runtime, returns the number
+     * of bytes written.
+     */
+    llvm::Value* genFormatPieces(const std::vector<FormatPiece>& pieces,
+                                 const std::vector<llvm::Value*>& args) {
+      auto rt = runtime();
+      llvm::Value* count = builder->getInt32(0);
+      size_t arg = 0;
+
+      for (const auto& piece : pieces) {
+        llvm::Value* written;
+
+        if (piece.conversion == 0) {
+          written = builder->CreateCall(rt.printBytes(),
+                                        {getStringPtr(piece.text),
+                                         builder->getInt64(piece.text.size())});
+        } else if (piece.conversion == 's') {
+          written = builder->CreateCall(rt.printStr(), {args[arg++]});
+        } else {
+          // Integers are converted as printf reads them: %d is an int, %ld
+          // a long, %u an unsigned (booleans are 0 or 1).
+          auto value = args[arg++];
+          auto isSigned =
+              !isUnsigned(value) && !value->getType()->isIntegerTy(1);
+          auto i32Ty = builder->getInt32Ty();
+          auto i64Ty = builder->getInt64Ty();
+          llvm::Function* printFn;
+
+          if (piece.conversion == 'd' && !piece.isLong) {
+            printFn = rt.printI32();
+            value = builder->CreateIntCast(value, i32Ty, isSigned);
+          } else if (piece.conversion == 'd') {
+            printFn = rt.printI64();
+            value = builder->CreateIntCast(value, i64Ty, isSigned);
+          } else {
+            printFn = rt.printU64();
+            if (!piece.isLong) {
+              value = builder->CreateIntCast(value, i32Ty, isSigned);
+              isSigned = false;
+            }
+            value = builder->CreateIntCast(value, i64Ty, isSigned);
+          }
+          written = builder->CreateCall(printFn, {value});
+        }
+
+        count = builder->CreateAdd(count, written);
+      }
+      return count;
+    }
+
+    /**
+     * Output runtime of the module. Its functions are shared by the
+     * modules of a session.
+     */
+    EvaRuntime runtime() {
+      return EvaRuntime(*module, sessionJit_
+                                     ? llvm::GlobalValue::LinkOnceODRLinkage
+                                     : llvm::GlobalValue::InternalLinkage);
+    }
+
+    /**
+     * Writes the buffered output, if the module uses the runtime (always
+     * in a session: the functions of previous forms may print).
+     */
+    void flushOutput() {
+      auto rt = runtime();
+      if (rt.isUsed() || sessionJit_) {
+        builder->CreateCall(rt.flush());
+      }
+    }
+
+    /**
+     * Function declaration: (def <name> (<params>) <body>)
+     *
+     *   (def square ((x number)) (* x x))
+     *   (def half ((x float)) -> float (/ x 2))
+     *
+     * Params and the result are i32 unless typed. Functions are
+     * internal to the module and use the fast calling convention. Small
+     * non-recursive ones are always inlined, recursive ones never are.
+     * Self-calls in tail position are `musttail`: recursion in tail
+     * position runs in constant stack space.
+     *
+     * Functions don't capture: the body sees the params, the globals
+     * and the functions.
+     *
+     * Async functions, (async <name> (<params>) <body>), are coroutines
+     * (see `genAwait`): a call runs the body till its first `await`, and
+     * returns 0; the event loop resumes it later. They have no result.
+     */
+    llvm::Value* genDef(const Exp& exp, bool isAsync = false) {
+      auto fnName = exp.list[1].symbol;
+      const auto& params = exp.list[2];
+
+      // Return type: (def name (params) -> type body)
+      auto hasReturnType = exp.list.size() == 6 &&
+                           exp.list[3].type == ExpType::SYMBOL &&
+                           exp.list[3].string == "->";
+      if (isAsync && hasReturnType) {
+        DIE << "Async function \"" << exp.list[1].string
+            << "\" has no result type.";
+      }
+      auto returnType = isAsync         ? builder->getVoidTy()
+                        : hasReturnType ? getType(exp.list[4])
+                                        : builder->getInt32Ty();
+      const auto& body = exp.list[hasReturnType ? 5 : 3];
+
+      std::vector<llvm::Type*> paramTypes;
+      for (const auto& param : params.list) {
+        paramTypes.push_back(extractVarType(param));
+      }
+
+      auto fnType = llvm::FunctionType::get(returnType, paramTypes,
+                                            /* vararg */ false);
+
+      // Built-in forms are reserved (functions of a session may be
+      // redefined by a later form):
+      auto isSessionFunction = sessionSymbols_.count(fnName) != 0 &&
+                               sessionSymbols_[fnName].isFunction;
+      if (fnName < forms_.size() && forms_[fnName] && !isSessionFunction) {
+        DIE << "\"" << exp.list[1].string
+            << "\" is a built-in form, it can't be a function name.";
+      }
+
+      // Functions of a session are external, and named by their form:
+      auto name = sessionJit_
+                      ? sessionName(fnName)
+                      : std::string(parser->ast.interner().name(fnName));
+      if (module->getFunction(name) != nullptr) {
+        DIE << "Function \"" << name << "\" is already defined.";
+      }
+
+      // Save the current function and block, the body is compiled
+      // into the new function:
+      auto prevFn = fn;
+      auto prevBlock = builder->GetInsertBlock();
+      auto prevCoroutine = coro_;
+      coro_ = {};
+
+      fn = createFunction(name, fnType,
+                          sessionJit_ ? llvm::Function::ExternalLinkage
+                                      : llvm::Function::InternalLinkage);
+      fn->setCallingConv(llvm::CallingConv::Fast);
+
+      auto isUnsignedResult =
+          hasReturnType && isUnsignedType(exp.list[4].string);
+      if (isUnsignedResult) {
+        unsigned_.insert(fn);
+      }
+
+      // Inlining hints (coroutines are inlined once split, if at all):
+      auto isRecursive = calls(body, fnName);
+      if (isAsync) {
+        fn->addFnAttr("coroutine.presplit", "0");
+        asyncDefined_ = true;
+      } else if (isRecursive) {
+        fn->addFnAttr(llvm::Attribute::NoInline);
+      } else if (countNodes(body) <= ALWAYS_INLINE_NODES) {
+        fn->addFnAttr(llvm::Attribute::AlwaysInline);
+      }
+
+      // Calls: (name args...), also from the body.
+      if (sessionJit_) {
+        setSessionSymbol(fnName, {name, fnType, /* isFunction */ true,
+                                  isUnsignedResult});
+        registerForm(parser->ast.interner().name(fnName),
+                     [this, fnName](const Exp& exp) {
+                       return callValue(
+                           genUserCall(getSessionFunction(fnName), exp));
+                     });
+      } else {
+        registerForm(parser->ast.interner().name(fnName),
+                     [this, callee = fn](const Exp& exp) {
+                       return callValue(genUserCall(callee, exp));
+                     });
+      }
+
+      if (isAsync) {
+        beginCoroutine();
+      }
+
+      // Params are allocated on the stack, as other variables:
+      env.enterScope();
+
+      auto i = 0;
+      for (auto& arg : fn->args()) {
+        const auto& param = params.list[i++];
+        auto paramName = extractVarName(param);
+        auto paramUnsigned = param.type == ExpType::LIST &&
+                             isUnsignedType(param.list[1].string);
+
+        arg.setName(llvm::StringRef(parser->ast.interner().name(paramName)));
+        if (paramUnsigned) {
+          unsigned_.insert(&arg);
+        }
+
+        auto paramBinding = allocVar(paramName, arg.getType(), paramUnsigned);
+        builder->CreateStore(&arg, paramBinding);
+      }
+
+      auto outerStackArrays = std::move(stackArrays_);
+      stackArrays_ = analyzeEscapes(body, &params);
+
+      if (isAsync) {
+        gen(body);
+        endCoroutine();
+      } else {
+        genReturn(body, fnName);
+      }
+
+      stackArrays_ = std::move(outerStackArrays);
+
+      env.exitScope();
+
+      auto function = fn;
+
+      fn = prevFn;
+      coro_ = prevCoroutine;
+      builder->SetInsertPoint(prevBlock);
+
+      return function;
+    }
+
+    /**
+     * Compiles an expression in tail position of the function `fnName`,
+     * and returns its value. The tail positions of `if` and `begin`
+     * return directly (no merge block), so a self-call in any of them is
+     * a `musttail` call followed by `ret`.
+     */
+    void genReturn(const Exp& exp, Symbol fnName) {
+      auto returnType = fn->getReturnType();
+      auto tag = exp.type == ExpType::LIST && exp.list.size() > 0 &&
+                         exp.list[0].type == ExpType::SYMBOL
+                     ? exp.list[0].symbol
+                     : OP_COUNT;
+
+      // (if <condition> <consequent> <alternate>)
+      if (tag == OP_IF) {
+        auto cond = toBool(gen(exp.list[1]));
+
+        auto thenBlock = createBB("then", fn);
+        auto elseBlock = createBB("else");
+        builder->CreateCondBr(cond, thenBlock, elseBlock);
+
+        builder->SetInsertPoint(thenBlock);
+        genReturn(exp.list[2], fnName);
+
+        fn->getBasicBlockList().push_back(elseBlock);
+        builder->SetInsertPoint(elseBlock);
+        if (exp.list.size() > 3) {
+          genReturn(exp.list[3], fnName);
+        } else {
+          builder->CreateRet(llvm::Constant::getNullValue(returnType));
+        }
+        return;
+      }
+
+      // (begin <expressions>)
+      if (tag == OP_BEGIN && exp.list.size() > 1) {
+        env.enterScope();
+        for (size_t i = 1; i < exp.list.size() - 1; i++) {
+          gen(exp.list[i]);
+        }
+        genReturn(exp.list[exp.list.size() - 1], fnName);
+        env.exitScope();
+        return;
+      }
+
+      // Self-call: (fnName args...)
+      if (tag == fnName) {
+        auto call = genUserCall(fn, exp);
+        call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+        builder->CreateRet(call);
+        return;
+      }
+
+      builder->CreateRet(convert(gen(exp), returnType, isUnsigned(fn)));
+    }
+
+    /**
+     * Call of a user function: (square 2)
+     */
+    llvm::CallInst* genUserCall(llvm::Function* callee, const Exp& exp) {
+      if (exp.list.size() - 1 != callee->arg_size()) {
+        DIE << "Function \"" << callee->getName().str() << "\" expects "
+            << callee->arg_size() << " arguments.";
+      }
+
+      std::vector<llvm::Value*> args{};
+
+      auto i = 1;
+      for (auto& param : callee->args()) {
+        args.push_back(convert(gen(exp.list[i++]), param.getType(),
+                               isUnsigned(&param)));
+      }
+
+      auto call = builder->CreateCall(callee, args);
+      call->setCallingConv(callee->getCallingConv());
+
+      if (isUnsigned(callee)) {
+        unsigned_.insert(call);
+      }
+      return call;
+    }
+
+    /**
+     * Value of a call: calls of async functions (no result) are 0.
+     */
+    llvm::Value* callValue(llvm::CallInst* call) {
+      if (call->getType()->isVoidTy()) {
+        return builder->getInt32(0);
+      }
+      return call;
+    }
+
+    /**
+     * Whether the expression calls the function anywhere: (<name> ...)
+     */
+    static bool calls(const Exp& exp, Symbol name) {
+      if (exp.type != ExpType::LIST || exp.list.size() == 0) {
+        return false;
+      }
+      if (exp.list[0].type == ExpType::SYMBOL && exp.list[0].symbol == name) {
+        return true;
+      }
+      for (const auto& entry : exp.list) {
+        if (calls(entry, name)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Number of AST nodes of the expression.
+     */
+    static size_t countNodes(const Exp& exp) {
+      size_t count = 1;
+      if (exp.type == ExpType::LIST) {
+        for (const auto& entry : exp.list) {
+          count += countNodes(entry);
+        }
+      }
+      return count;
+    }
+
+    /**
+     * Functions with bodies of up to this many AST nodes are always
+     * inlined.
+     */
+    static constexpr size_t ALWAYS_INLINE_NODES = 16;
+
+    /**
+     * Escape analysis of the heap arrays of a function body, or of a
+     * top-level form: (new-array T n), (arena-array T n).
+     *
+     * An array doesn't escape if it is held only by variables declared
+     * in the body, used only to access the elements: get, put, len,
+     * the elementwise forms and delete-array. Any other use (argument of
+     * a call, copy to another variable, value of a block or of the
+     * body, ...) escapes, also through the value of an elementwise form,
+     * which is its first array. Variables are tracked by name: all the
+     * variables of a name escape together. Params, and a top-level
+     * (var ...) form, which outlive the body, escape.
+     *
+     * Non-escaping arrays of a constant length (up to STACK_ARRAY_LENGTH)
+     * are allocated on the stack instead, in the entry block: one slot
+     * per site, reused by the iterations of a loop (the previous array
+     * is not reachable anymore). Their delete-array is a no-op.
+     */
+    StackArrays analyzeEscapes(const Exp& body, const Exp* params = nullptr) {
+      EscapeState state;
+
+      if (params != nullptr) {
+        for (const auto& param : params->list) {
+          state.escaped.insert(extractVarName(param));
+        }
+      }
+      if (isVarForm(body)) {
+        state.escaped.insert(extractVarName(body.list[1]));
+      }
+
+      walkEscapes(body, state);
+
+      StackArrays result;
+      for (const auto& [name, sites] : state.sites) {
+        if (state.declared.count(name) && !state.escaped.count(name)) {
+          result.vars.insert(name);
+          result.sites.insert(sites.begin(), sites.end());
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Arrays assigned to the variables of a body, declared variables,
+     * and the escaping ones.
+     */
+    struct EscapeState {
+      std::unordered_map<Symbol, std::vector<const Exp*>> sites;
+      std::unordered_set<Symbol> declared;
+      std::unordered_set<Symbol> escaped;
+    };
+
+    /**
+     * Walks an expression, whose value escapes unless it is only accessed
+     * (the array of a get, ...) or not used (a statement of a block).
+     */
+    void walkEscapes(const Exp& exp, EscapeState& state,
+                     bool escapes = true) {
+      if (exp.type == ExpType::SYMBOL) {
+        if (escapes) {
+          state.escaped.insert(exp.symbol);
+        }
+        return;
+      }
+      if (exp.type != ExpType::LIST || exp.list.size() == 0) {
+        return;
+      }
+
+      auto tag = exp.list[0].type == ExpType::SYMBOL ? exp.list[0].symbol
+                                                     : OP_COUNT;
+
+      // Operands from `accessedFirst` to `accessed` are only accessed.
+      size_t accessedFirst = 1;
+      size_t accessed = 0;
+
+      switch (tag) {
+        // (var x <value>), (set x <value>)
+        case OP_VAR:
+        case OP_SET: {
+          if (exp.list.size() != 3) {
+            break;
+          }
+          auto name = extractVarName(exp.list[1]);
+          if (tag == OP_VAR) {
+            state.declared.insert(name);
+          }
+
+          const auto& value = exp.list[2];
+          if (isStackArrayCandidate(value)) {
+            state.sites[name].push_back(&value);
+          } else {
+            state.escaped.insert(name);
+            walkEscapes(value, state);
+          }
+          return;
+        }
+
+        // Element access: (get a i), (vadd a b), ...
+        case OP_GET:
+        case OP_PUT:
+        case OP_LEN:
+        case OP_VSUM:
+        case OP_DELETE_ARRAY:
+        case OP_PIPE:
+          accessed = 1;
+          break;
+
+        // The value is the first array: (var b (vadd a 1)) escapes `a`.
+        case OP_VADD:
+        case OP_VSUB:
+        case OP_VMUL:
+        case OP_VDIV:
+          accessed = 2;
+          accessedFirst = escapes ? 2 : 1;
+          break;
+
+        // Blocks: only the value of the last expression is used.
+        case OP_BEGIN:
+        case OP_REGION:
+          for (size_t i = 1; i < exp.list.size(); i++) {
+            walkEscapes(exp.list[i], state,
+                        escapes && i == exp.list.size() - 1);
+          }
+          return;
+
+        // Functions are analyzed on their own.
+        case OP_DEF:
+        case OP_ASYNC:
+          return;
+      }
+
+      for (size_t i = tag == OP_COUNT ? 0 : 1; i < exp.list.size(); i++) {
+        walkEscapes(exp.list[i], state, i < accessedFirst || i > accessed);
+      }
+    }
+
+    /**
+     * Whether the expression is a heap array allocation which may be
+     * moved to the stack: of a constant length, up to STACK_ARRAY_LENGTH.
+     */
+    static bool isStackArrayCandidate(const Exp& exp) {
+      return exp.type == ExpType::LIST && exp.list.size() == 3 &&
+             exp.list[0].type == ExpType::SYMBOL &&
+             (exp.list[0].symbol == OP_NEW_ARRAY ||
+              exp.list[0].symbol == OP_ARENA_ARRAY) &&
+             exp.list[2].type == ExpType::NUMBER && exp.list[2].number >= 0 &&
+             exp.list[2].number <= STACK_ARRAY_LENGTH;
+    }
+
+    /**
+     * Maximal length of a heap array allocated on the stack.
+     */
+    static constexpr int64_t STACK_ARRAY_LENGTH = 1024;
+
+    /**
+     * Fixed-size array: (array <type> <size>)
+     *
+     *   (var a (array float 8))
+     *
+     * Allocated zeroed on the stack of the function, the size is a
+     * number literal. Arrays are {data, length} values, passed and
+     * stored by value (the elements are shared), with no bounds checks.
+     */
+    llvm::Value* genArray(const Exp& exp) {
+      auto arrayType = getArrayType(exp.list[1].string);
+
+      if (exp.list[2].type != ExpType::NUMBER || exp.list[2].number < 0) {
+        DIE << "Array size should be a number literal.";
+      }
+      return allocStackArray(arrayType, (uint64_t)exp.list[2].number);
+    }
+
+    /**
+     * Allocates a zeroed array in the entry block of the function.
+     */
+    llvm::Value* allocStackArray(llvm::StructType* arrayType, uint64_t size) {
+      auto elemType = getElementType(arrayType);
+      auto& entry = fn->getEntryBlock();
+      varsBuilder->SetInsertPoint(&entry, entry.getFirstInsertionPt());
+      auto storage = varsBuilder->CreateAlloca(
+          llvm::ArrayType::get(elemType, size), 0, "array");
+
+      auto data = builder->CreateConstInBoundsGEP2_64(storage->getAllocatedType(),
+                                                      storage, 0, 0, "data");
+      builder->CreateMemSet(data, builder->getInt8(0),
+          builder->CreateMul(builder->getInt64(size), getSizeOf(elemType)),
+          llvm::MaybeAlign());
+
+      return makeArray(arrayType, data, builder->getInt64(size));
+    }
+
+    /**
+     * Heap-allocated array: (new-array <type> <length>)
+     *
+     * Zeroed, the length is computed at run time. Freed with
+     * (delete-array a).
+     */
+    llvm::Value* genNewArray(const Exp& exp) {
+      auto arrayType = getArrayType(exp.list[1].string);
+      auto elemType = getElementType(arrayType);
+
+      if (stackArrays_.sites.count(&exp)) {
+        return allocStackArray(arrayType, (uint64_t)exp.list[2].number);
+      }
+      auto length = convert(gen(exp.list[2]), builder->getInt64Ty(), false);
+
+      auto calloc = module->getOrInsertFunction("calloc",
+          builder->getInt8PtrTy(), builder->getInt64Ty(),
+          builder->getInt64Ty());
+      auto bytes = builder->CreateCall(calloc, {length, getSizeOf(elemType)});
+
+      return makeArray(
+          arrayType,
+          builder->CreateBitCast(bytes, elemType->getPointerTo(), "data"),
+          length);
+    }
+
+    /**
+     * Frees a heap-allocated array: (delete-array a)
+     */
+    llvm::Value* genDeleteArray(const Exp& exp) {
+      // Allocated on the stack, see analyzeEscapes:
+      if (exp.list[1].type == ExpType::SYMBOL &&
+          stackArrays_.vars.count(exp.list[1].symbol)) {
+        return builder->getInt32(0);
+      }
+
+      auto array = genArrayOperand(exp, 1);
+
+      auto free = module->getOrInsertFunction("free",
+          builder->getVoidTy(), builder->getInt8PtrTy());
+      builder->CreateCall(free, builder->CreateBitCast(arrayData(array),
+                                                       builder->getInt8PtrTy()));
+      return builder->getInt32(0);
+    }
+
+    /**
+     * Arena-allocated array: (arena-array <type> <length>)
+     *
+     * Zeroed, allocated at the cost of a pointer bump. Not freed on its
+     * own: released with the enclosing (region ...), if any.
+     */
+    llvm::Value* genArenaArray(const Exp& exp) {
+      auto arrayType = getArrayType(exp.list[1].string);
+      auto elemType = getElementType(arrayType);
+
+      if (stackArrays_.sites.count(&exp)) {
+        return allocStackArray(arrayType, (uint64_t)exp.list[2].number);
+      }
+      auto length = convert(gen(exp.list[2]), builder->getInt64Ty(), false);
+      auto size = builder->CreateMul(length, getSizeOf(elemType));
+
+      auto bytes = builder->CreateCall(runtime().arenaAlloc(), {size});
+      builder->CreateMemSet(bytes, builder->getInt8(0), size,
+                            getElementAlign(elemType));
+
+      return makeArray(
+          arrayType,
+          builder->CreateBitCast(bytes, elemType->getPointerTo(), "data"),
+          length);
+    }
+
+    /**
+     * Region: (region <expressions>)
+     *
+     * Compiled as (begin ...), and the arena objects allocated in it are
+     * released at its end, all at once.
+     *
+     * Nothing allocated in the region may be used after it: its result
+     * can't be an array (a compile error), and arena arrays should not
+     * be stored to the variables outside of it.
+     *
+     * The arena is shared by all the coroutines, so a region can't
+     * contain an await (a compile error): another coroutine would run
+     * while it is open, and its regions would be released out of order.
+     */
+    llvm::Value* genRegion(const Exp& exp) {
+      auto rt = runtime();
+
+      auto mark = builder->CreateCall(rt.arenaMark(), {}, "mark");
+      coro_.regions++;
+      auto result = genBegin(exp);
+      coro_.regions--;
+      if (isArrayType(result->getType())) {
+        DIE << "The result of a region can't be an array, its arena "
+               "objects are released at the end of the region.";
+      }
+      builder->CreateCall(rt.arenaReset(), {mark});
+
+      return result;
+    }
+
+    /**
+     * Starts the coroutine of an async function, in its entry block.
+     *
+     * The frame is allocated with malloc (if `coro.alloc` says so, as
+     * the intrinsics require): the handle is passed to the event loop,
+     * which outlives the caller, so the frame is never elided to the
+     * caller's stack.
+     */
+    void beginCoroutine() {
+      auto bytePtrTy = builder->getInt8PtrTy();
+      auto null = llvm::ConstantPointerNull::get(bytePtrTy);
+
+      coro_.id = builder->CreateIntrinsic(
+          llvm::Intrinsic::coro_id, {},
+          {builder->getInt32(0), null, null, null}, nullptr, "id");
+      auto needAlloc = builder->CreateIntrinsic(llvm::Intrinsic::coro_alloc,
+                                                {}, {coro_.id});
+
+      auto entryBlock = builder->GetInsertBlock();
+      auto allocBlock = createBB("coro.alloc", fn);
+      auto beginBlock = createBB("coro.begin", fn);
+      builder->CreateCondBr(needAlloc, allocBlock, beginBlock);
+
+      builder->SetInsertPoint(allocBlock);
+      auto size = builder->CreateIntrinsic(llvm::Intrinsic::coro_size,
+                                           {builder->getInt64Ty()}, {});
+      auto mallocFn = module->getOrInsertFunction("malloc", bytePtrTy,
+                                                  builder->getInt64Ty());
+      auto allocated = builder->CreateCall(mallocFn, {size});
+      builder->CreateBr(beginBlock);
+
+      builder->SetInsertPoint(beginBlock);
+      auto memory = builder->CreatePHI(bytePtrTy, 2, "frame");
+      memory->addIncoming(null, entryBlock);
+      memory->addIncoming(allocated, allocBlock);
+
+      coro_.handle = builder->CreateIntrinsic(
+          llvm::Intrinsic::coro_begin, {}, {coro_.id, memory}, nullptr,
+          "handle");
+      coro_.cleanup = createBB("coro.cleanup");
+      coro_.suspend = createBB("coro.suspend");
+    }
+
+    /**
+     * Completes the coroutine: the body falls through to the cleanup
+     * (frees the frame), and then to the suspend block, which returns to
+     * the caller or the resumer.
+     */
+    void endCoroutine() {
+      builder->CreateBr(coro_.cleanup);
+
+      fn->getBasicBlockList().push_back(coro_.cleanup);
+      builder->SetInsertPoint(coro_.cleanup);
+      auto memory = builder->CreateIntrinsic(llvm::Intrinsic::coro_free, {},
+                                             {coro_.id, coro_.handle});
+      auto freeFn = module->getOrInsertFunction(
+          "free", builder->getVoidTy(), builder->getInt8PtrTy());
+      builder->CreateCall(freeFn, {memory});
+      builder->CreateBr(coro_.suspend);
+
+      fn->getBasicBlockList().push_back(coro_.suspend);
+      builder->SetInsertPoint(coro_.suspend);
+      builder->CreateIntrinsic(llvm::Intrinsic::coro_end, {},
+                               {coro_.handle, builder->getFalse()});
+      builder->CreateRetVoid();
+    }
+
+    /**
+     * Await: (await <event>), in an async function
+     *
+     *   (await (sleep 100))     ; 100 ms passed
+     *   (await (readable fd))   ; data to read from fd (e.g. a pipe)
+     *
+     * Suspends the function, and returns to its caller (or to the event
+     * loop); the loop resumes it after the event. Result is 0.
+     */
+    llvm::Value* genAwait(const Exp& exp) {
+      if (coro_.handle == nullptr) {
+        DIE << "await outside of an async function.";
+      }
+      if (coro_.regions > 0) {
+        DIE << "await inside a region: the arena is shared by the async "
+               "functions, the region can't stay open while others run."
+            << getLocation(exp) << "\n";
+      }
+
+      const auto& event = exp.list[1];
+      auto eventName = event.type == ExpType::LIST && event.list.size() == 2
+                           ? event.list[0].string
+                           : std::string_view();
+      if (eventName != "sleep" && eventName != "readable") {
+        DIE << "await expects (sleep <ms>) or (readable <fd>).";
+      }
+
+      auto rt = runtime();
+      auto arg = convert(gen(event.list[1]), builder->getInt32Ty(), false);
+
+      // A timer is a descriptor of its own, closed once fired.
+      auto isSleep = eventName == "sleep";
+      auto fd = isSleep ? builder->CreateCall(rt.sleepFd(), {arg}) : arg;
+      builder->CreateCall(rt.awaitFd(),
+                          {coro_.handle, fd, builder->getInt1(isSleep)});
+
+      auto state = builder->CreateIntrinsic(
+          llvm::Intrinsic::coro_suspend, {},
+          {llvm::ConstantTokenNone::get(module->getContext()),
+           builder->getFalse()});
+
+      // 0: resumed, 1: destroyed, otherwise: suspended.
+      auto resumeBlock = createBB("resume", fn);
+      auto dispatch = builder->CreateSwitch(state, coro_.suspend, 2);
+      dispatch->addCase(builder->getInt8(0), resumeBlock);
+      dispatch->addCase(builder->getInt8(1), coro_.cleanup);
+
+      builder->SetInsertPoint(resumeBlock);
+      return builder->getInt32(0);
+    }
+
+    /**
+     * Pipe: (pipe fds), fds is a number array of 2
+     *
+     * Opens a pipe, its read and write ends are stored in fds. Result is
+     * 0, or -1 on error.
+     */
+    llvm::Value* genPipe(const Exp& exp) {
+      auto fds = genArrayOperand(exp, 1);
+      if (getElementType(fds->getType()) != builder->getInt32Ty()) {
+        DIE << "pipe expects a number array.";
+      }
+
+      auto pipeFn = module->getOrInsertFunction(
+          "pipe", builder->getInt32Ty(),
+          builder->getInt32Ty()->getPointerTo());
+      return builder->CreateCall(pipeFn, {arrayData(fds)});
+    }
+
+    /**
+     * Message: (send fd value), writes a number to fd
+     *
+     * Result is the number of bytes written (4), or -1 on error.
+     */
+    llvm::Value* genSend(const Exp& exp) {
+      auto fd = convert(gen(exp.list[1]), builder->getInt32Ty(), false);
+      auto value = convert(gen(exp.list[2]), builder->getInt32Ty(), false);
+
+      auto message = allocMessage();
+      builder->CreateStore(value, message);
+
+      auto writeFn = module->getOrInsertFunction(
+          "write", builder->getInt64Ty(), builder->getInt32Ty(),
+          builder->getInt8PtrTy(), builder->getInt64Ty());
+      auto bytes = builder->CreateBitCast(message, builder->getInt8PtrTy());
+      auto written =
+          builder->CreateCall(writeFn, {fd, bytes, builder->getInt64(4)});
+      return builder->CreateTrunc(written, builder->getInt32Ty());
+    }
+
+    /**
+     * Message: (receive fd), reads a number sent to fd
+     *
+     * Blocks till there is one: (await (readable fd)) first, in an async
+     * function.
+     */
+    llvm::Value* genReceive(const Exp& exp) {
+      auto fd = convert(gen(exp.list[1]), builder->getInt32Ty(), false);
+
+      auto message = allocMessage();
+      builder->CreateStore(builder->getInt32(0), message);
+
+      auto readFn = module->getOrInsertFunction(
+          "read", builder->getInt64Ty(), builder->getInt32Ty(),
+          builder->getInt8PtrTy(), builder->getInt64Ty());
+      auto bytes = builder->CreateBitCast(message, builder->getInt8PtrTy());
+      builder->CreateCall(readFn, {fd, bytes, builder->getInt64(4)});
+      return builder->CreateLoad(builder->getInt32Ty(), message, "message");
+    }
+
+    /**
+     * Buffer of a sent or received number, in the entry block.
+     */
+    llvm::AllocaInst* allocMessage() {
+      auto& entry = fn->getEntryBlock();
+      varsBuilder->SetInsertPoint(&entry, entry.getFirstInsertionPt());
+      return varsBuilder->CreateAlloca(builder->getInt32Ty(), 0, "message");
+    }
+
+    /**
+     * Runs the event loop till the async functions are done, if the
+     * module (or, in a session, any form) has some.
+     */
+    void runEventLoop() {
+      auto rt = runtime();
+      if (rt.isLoopUsed() || asyncDefined_) {
+        builder->CreateCall(rt.loopRun());
+      }
+    }
+
+    /**
+     * Element: (get a i)
+     */
+    llvm::Value* genGet(const Exp& exp) {
+      auto array = genArrayOperand(exp, 1);
+      auto elemType = getElementType(array->getType());
+      auto index = convert(gen(exp.list[2]), builder->getInt64Ty(), false);
+
+      auto ptr = builder->CreateInBoundsGEP(elemType, arrayData(array), index);
+      auto elem = builder->CreateLoad(elemType, ptr, "elem");
+      if (isUnsignedArray(array->getType())) {
+        unsigned_.insert(elem);
+      }
+      return elem;
+    }
+
+    /**
+     * Element update: (put a i value)
+     */
+    llvm::Value* genPut(const Exp& exp) {
+      auto array = genArrayOperand(exp, 1);
+      auto elemType = getElementType(array->getType());
+      auto index = convert(gen(exp.list[2]), builder->getInt64Ty(), false);
+      auto value = convert(gen(exp.list[3]), elemType,
+                           isUnsignedArray(array->getType()));
+
+      auto ptr = builder->CreateInBoundsGEP(elemType, arrayData(array), index);
+      builder->CreateStore(value, ptr);
+      return value;
+    }
+
+    /**
+     * Elementwise operations, in place: (vadd a b), (vmul a 2)
+     *
+     * a[i] = a[i] op b[i] for the common length, or a[i] = a[i] op b for
+     * a number. The result is `a`.
+     *
+     * Lowered to a loop over vectors of the target SIMD width
+     * (<8 x i32>, <4 x double> with AVX), and a scalar loop over the
+     * remaining elements.
+     */
+    llvm::Value* genElementwise(const Exp& exp, Symbol op) {
+      auto array = genArrayOperand(exp, 1);
+      auto elemType = getElementType(array->getType());
+      checkNumberElements(exp, elemType);
+      auto data = arrayData(array);
+      auto length = arrayLength(array);
+
+      auto operand = gen(exp.list[2]);
+      llvm::Value* otherData = nullptr;
+
+      if (isArrayType(operand->getType())) {
+        if (operand->getType() != array->getType()) {
+          DIE << "Elementwise operation on arrays of different types.";
+        }
+        otherData = arrayData(operand);
+
+        auto otherLength = arrayLength(operand);
+        length = builder->CreateSelect(
+            builder->CreateICmpULT(length, otherLength), length, otherLength,
+            "len");
+      } else {
+        operand = convert(operand, elemType, isUnsigned(operand));
+      }
+
+      genVectorLoop(length, elemType, nullptr,
+          [&](llvm::Value* index, unsigned width, llvm::Value* acc) {
+            auto lhs = loadElements(data, index, elemType, width);
+            auto rhs = otherData != nullptr
+                           ? loadElements(otherData, index, elemType, width)
+                           : (width > 1 ? builder->CreateVectorSplat(width, operand)
+                                        : operand);
+
+            // Unsigned elements: udiv instead of sdiv.
+            if (isUnsignedArray(array->getType())) {
+              unsigned_.insert(lhs);
+            }
+            storeElements(data, index, emitBinary(op, lhs, rhs), width);
+            return acc;
+          });
+
+      return array;
+    }
+
+    /**
+     * Sum of the elements: (vsum a)
+     *
+     * Accumulated in vectors of the target SIMD width, then reduced:
+     * floating point sums are reassociated.
+     */
+    llvm::Value* genVsum(const Exp& exp) {
+      auto array = genArrayOperand(exp, 1);
+      auto elemType = getElementType(array->getType());
+      checkNumberElements(exp, elemType);
+      auto data = arrayData(array);
+
+      auto sum = genVectorLoop(arrayLength(array), elemType,
+          llvm::Constant::getNullValue(elemType),
+          [&](llvm::Value* index, unsigned width, llvm::Value* acc) {
+            return emitBinary(OP_ADD, acc,
+                              loadElements(data, index, elemType, width));
+          });
+      if (isUnsignedArray(array->getType())) {
+        unsigned_.insert(sum);
+      }
+      return sum;
+    }
+
+    /**
+     * Elementwise forms work on arrays of numbers, not of booleans or
+     * strings.
+     */
+    void checkNumberElements(const Exp& exp, llvm::Type* elemType) {
+      if (!isNumberType(elemType)) {
+        DIE << "\"" << exp.list[0].string << "\": array of numbers "
+            << "expected, got elements of " << typeName(elemType) << ".";
+      }
+    }
+
+    static bool isNumberType(llvm::Type* type) {
+      return (type->isIntegerTy() && !type->isIntegerTy(1)) ||
+             type->isDoubleTy();
+    }
+
+    /**
+     * Loop body of `genVectorLoop`: processes the `width` elements at
+     * the index, and returns the next accumulator.
+     */
+    using VectorLoopBody = std::function<llvm::Value*(
+        llvm::Value* index, unsigned width, llvm::Value* acc)>;
+
+    /**
+     * Emits a loop over `length` elements: a vector loop by the target
+     * SIMD width, then a scalar loop for the rest. The scalar `acc`
+     * (if any) is carried through both loops: the vector accumulator
+     * starts at zero and is reduced in between. Returns the final `acc`.
+     */
+    llvm::Value* genVectorLoop(llvm::Value* length, llvm::Type* elemType,
+                               llvm::Value* acc, VectorLoopBody body) {
+      auto width = getVectorWidth(elemType);
+      llvm::Value* index = builder->getInt64(0);
+
+      if (width > 1) {
+        // Whole vectors: [0, length & -width)
+        auto vectorEnd = builder->CreateAnd(length, ~(uint64_t)(width - 1),
+                                            "vecend");
+
+        llvm::Value* vectorAcc = nullptr;
+        if (acc != nullptr) {
+          vectorAcc = llvm::Constant::getNullValue(
+              llvm::FixedVectorType::get(elemType, width));
+        }
 
-          return builder->CreateGlobalStringPtr(str);
+        vectorAcc = genCountedLoop(index, vectorEnd, width, vectorAcc,
+            [&](llvm::Value* i, llvm::Value* a) { return body(i, width, a); });
+
+        if (acc != nullptr) {
+          acc = emitBinary(OP_ADD, acc, reduceAdd(vectorAcc));
         }
+        index = vectorEnd;
+      }
 
-        /**
-         * ---------------------------------------
-         * Lists.
-         */
-        case ExpType::LIST:
-          auto tag = exp.list[0];
+      // Remaining elements:
+      return genCountedLoop(index, length, 1, acc,
+          [&](llvm::Value* i, llvm::Value* a) { return body(i, 1, a); });
+    }
 
-          /**
-           * -------------------------------------
-           * Special cases.
-           */
-          if (tag.type == ExpType::SYMBOL) {
-            auto op = tag.string;
+    /**
+     * Emits a loop for (i = start; i < end; i += step), with an optional
+     * accumulator carried as a phi. Returns the final accumulator.
+     */
+    llvm::Value* genCountedLoop(llvm::Value* start, llvm::Value* end,
+        uint64_t step, llvm::Value* acc,
+        std::function<llvm::Value*(llvm::Value*, llvm::Value*)> body) {
+      auto preheader = builder->GetInsertBlock();
+      auto condBlock = createBB("vcond", fn);
+      auto bodyBlock = createBB("vbody");
+      auto endBlock = createBB("vend");
+
+      builder->CreateBr(condBlock);
+      builder->SetInsertPoint(condBlock);
+
+      auto index = builder->CreatePHI(builder->getInt64Ty(), 2, "i");
+      index->addIncoming(start, preheader);
+
+      llvm::PHINode* accPhi = nullptr;
+      if (acc != nullptr) {
+        accPhi = builder->CreatePHI(acc->getType(), 2, "acc");
+        accPhi->addIncoming(acc, preheader);
+      }
 
-            // -----------------------------------
-            // Binary math operations:
+      builder->CreateCondBr(builder->CreateICmpULT(index, end), bodyBlock,
+                            endBlock);
 
-            if (op == "+") {
-              GEN_BINARY_OP(CreateAdd, "tmpadd");
-            }
+      fn->getBasicBlockList().push_back(bodyBlock);
+      builder->SetInsertPoint(bodyBlock);
 
-            else if (op == "-") {
-              GEN_BINARY_OP(CreateSub, "tmpsub");
-            }
+      auto next = body(index, accPhi);
+      auto nextIndex = builder->CreateAdd(index, builder->getInt64(step), "",
+                                          /* HasNUW */ true);
 
-            else if (op == "*") {
-              GEN_BINARY_OP(CreateMul, "tmpmul");
-            }
+      auto latch = builder->GetInsertBlock();
+      index->addIncoming(nextIndex, latch);
+      if (accPhi != nullptr) {
+        accPhi->addIncoming(next, latch);
+      }
+      builder->CreateBr(condBlock);
 
-            else if (op == "/") {
-              GEN_BINARY_OP(CreateSDiv, "tmpdiv");
-            }
+      fn->getBasicBlockList().push_back(endBlock);
+      builder->SetInsertPoint(endBlock);
 
-            // -----------------------------------
-            // Compare operations: (> 5 10)
-            
-            // UGT - unsigned, greater than
-            else if(op == ">") {
-              GEN_BINARY_OP(CreateICmpUGT, "tmpcmp");
-            }
+      return accPhi;
+    }
 
-            // ULT - unsigned, less  than
-            else if(op == "<") {
-              GEN_BINARY_OP(CreateICmpULT, "tmpcmp");
-            }
+    /**
+     * Loads `width` elements at the index: a scalar, or a vector.
+     */
+    llvm::Value* loadElements(llvm::Value* data, llvm::Value* index,
+                              llvm::Type* elemType, unsigned width) {
+      auto ptr = builder->CreateInBoundsGEP(elemType, data, index);
+      if (width == 1) {
+        return builder->CreateLoad(elemType, ptr);
+      }
 
-            // EQ = equal
-            else if(op == "==") {
-              GEN_BINARY_OP(CreateICmpEQ, "tmpcmp");
-            }
+      auto vectorType = llvm::FixedVectorType::get(elemType, width);
+      return builder->CreateAlignedLoad(
+          vectorType, builder->CreateBitCast(ptr, vectorType->getPointerTo()),
+          getElementAlign(elemType));
+    }
 
-            // NE = not equal
-            else if(op == "!=") {
-              GEN_BINARY_OP(CreateICmpNE, "tmpcmp");
-            }
+    /**
+     * Stores `width` elements at the index.
+     */
+    void storeElements(llvm::Value* data, llvm::Value* index,
+                       llvm::Value* value, unsigned width) {
+      auto elemType = value->getType()->getScalarType();
+      auto ptr = builder->CreateInBoundsGEP(elemType, data, index);
+      if (width > 1) {
+        ptr = builder->CreateBitCast(ptr, value->getType()->getPointerTo());
+      }
+      builder->CreateAlignedStore(value, ptr, getElementAlign(elemType));
+    }
 
-            // UGE = greater or equal
-            else if(op == ">=") {
-              GEN_BINARY_OP(CreateICmpUGE, "tmpcmp");
-            }
+    /**
+     * Sum of the vector lanes.
+     */
+    llvm::Value* reduceAdd(llvm::Value* vector) {
+      if (!vector->getType()->isFPOrFPVectorTy()) {
+        return builder->CreateAddReduce(vector);
+      }
 
-            // ULE = less or equal
-            else if(op == "<=") {
-              GEN_BINARY_OP(CreateICmpULE, "tmpcmp");
-            }
+      auto sum = builder->CreateFAddReduce(
+          llvm::ConstantFP::get(vector->getType()->getScalarType(), 0.0),
+          vector);
+      llvm::cast<llvm::Instruction>(sum)->setHasAllowReassoc(true);
+      return sum;
+    }
+
+    /**
+     * Number of elements of the type in a SIMD register of the target
+     * (1 if it's not a number).
+     */
+    unsigned getVectorWidth(llvm::Type* elemType) {
+      if (!isNumberType(elemType)) {
+        return 1;
+      }
+      auto elemBits = elemType->getPrimitiveSizeInBits().getFixedSize();
 
-            // -----------------------------------
-            // Variable declaration: (var x (+ y 10))
-            //
-            // Typed: (var (x number) 42)
-            //
-            // Note: locals are allocated on the stack
+      if (vectorBits_ == 0) {
+        vectorBits_ = getVectorBits();
+      }
+      return std::max(1u, vectorBits_ / (unsigned)elemBits);
+    }
 
-            if (op == "var") {
-              auto varNameDecl = exp.list[1];
-              auto varName = extractVarName(varNameDecl);
+    /**
+     * SIMD register size: of the native target, or of the host CPU.
+     */
+    unsigned getVectorBits() {
+      if (target) {
+        auto tti = target->getTargetMachine()->getTargetTransformInfo(*fn);
+        return tti.getRegisterBitWidth(
+                      llvm::TargetTransformInfo::RGK_FixedWidthVector)
+            .getFixedSize();
+      }
 
-              // Initializer:
-              auto init = gen(exp.list[2], env);
+      llvm::StringMap<bool> features;
+      llvm::sys::getHostCPUFeatures(features);
 
-              // Type:
-              auto varTy = extractVarType(varNameDecl);
+      if (features.lookup("avx512f")) {
+        return 512;
+      }
+      if (features.lookup("avx")) {
+        return 256;
+      }
+      return 128;
+    }
 
-              // Vardiable:
-              auto varBinding = allocVar(varName, varTy, env);
+    /**
+     * Array type: {T* data, i64 length}, named "array.<T>" after the
+     * element type, with its signedness: array.i32, array.u32,
+     * array.double, ...
+     */
+    llvm::StructType* getArrayType(llvm::Type* elemType,
+                                   bool isUnsignedElem = false) {
+      auto name = "array." + (isUnsignedElem ? "u" + std::to_string(
+                                                   elemType->getIntegerBitWidth())
+                                             : typeName(elemType));
+      if (auto type = llvm::StructType::getTypeByName(module->getContext(),
+                                                     name)) {
+        return type;
+      }
+      return llvm::StructType::create(
+          module->getContext(), {elemType->getPointerTo(),
+                                 builder->getInt64Ty()}, name);
+    }
 
-              // Set value:
-              return builder->CreateStore(init, varBinding);
-            } 
+    /**
+     * Array type of an element type name: number, u64, float, ...
+     */
+    llvm::StructType* getArrayType(std::string_view elemType) {
+      return getArrayType(getTypeFromString(elemType),
+                          isUnsignedType(elemType));
+    }
 
-            // -----------------------------------
-            // Variable update: (set x 100)
+    static bool isArrayType(llvm::Type* type) {
+      auto structType = llvm::dyn_cast<llvm::StructType>(type);
+      return structType != nullptr && structType->hasName() &&
+             structType->getName().startswith("array.");
+    }
 
-            else if (op == "set") {
-              auto value = gen(exp.list[2], env);
+    /**
+     * Element type of an array type, from its name.
+     */
+    llvm::Type* getElementType(llvm::Type* arrayType) {
+      auto name = arrayType->getStructName();
+      name.consume_front("array.");
 
-              auto varName = exp.list[1].string;
+      if (name == "double") {
+        return builder->getDoubleTy();
+      }
+      if (name == "i8*") {
+        return builder->getInt8PtrTy();
+      }
 
-              // Variable:
-              auto varBinding = env->lookup(varName);
+      // iN, uN:
+      unsigned bits = 0;
+      name.drop_front().getAsInteger(10, bits);
+      return builder->getIntNTy(bits);
+    }
 
-              // Set value:
-              return builder->CreateStore(value, varBinding);
-            }
+    static bool isUnsignedArray(llvm::Type* arrayType) {
+      return arrayType->getStructName().startswith("array.u");
+    }
 
-            // -----------------------------------
-            // printf extern function:
-            //
-            // (printf "Value: %d" 42)
-            //
-
-            else if (op == "printf") {
-              auto printfFn = module->getFunction("printf");
-              
-              std::vector<llvm::Value*> args{};
-              
-              for (auto i = 1; i < exp.list.size(); i++) {
-                args.push_back(gen(exp.list[i], env));
-              }
-              return builder->CreateCall(printfFn, args);
-          } 
-
-          // -----------------------------------
-          // Blocks: (begin <expression>)
-
-          else if (op == "begin") {
-            // Block scope:
-            auto blockEnv = std::make_shared<Environment>(
-                std::map<std::string, llvm::Value*>{}, env);
-
-            // Compile each expression within the block
-            // Result is the last evaluated expression
-            llvm::Value* blockRes;
-            for (auto i = 1; i < exp.list.size(); i++) {
-              //Generate expression code
-              blockRes = gen(exp.list[i], blockEnv); // TODO local block env
-            }
-            return blockRes;
-          }
-        }
+    /**
+     * Compiles the array operand of a form.
+     */
+    llvm::Value* genArrayOperand(const Exp& exp, size_t i) {
+      auto array = gen(exp.list[i]);
+      if (!isArrayType(array->getType())) {
+        DIE << "\"" << exp.list[0].string << "\": array expected, got "
+            << typeName(array->getType()) << ".";
       }
-      // Unreachable
-      return builder->getInt32(0);
+      return array;
+    }
+
+    llvm::Value* makeArray(llvm::StructType* arrayType, llvm::Value* data,
+                           llvm::Value* length) {
+      llvm::Value* array = llvm::UndefValue::get(arrayType);
+      array = builder->CreateInsertValue(array, data, 0);
+      return builder->CreateInsertValue(array, length, 1, "array");
+    }
+
+    llvm::Value* arrayData(llvm::Value* array) {
+      return builder->CreateExtractValue(array, 0, "data");
+    }
+
+    llvm::Value* arrayLength(llvm::Value* array) {
+      return builder->CreateExtractValue(array, 1, "len");
+    }
+
+    /**
+     * Size of the type in bytes (folded once the data layout is set).
+     */
+    llvm::Constant* getSizeOf(llvm::Type* type) {
+      return llvm::ConstantExpr::getSizeOf(type);
+    }
+
+    /**
+     * ABI alignment of an element (of the data layout).
+     */
+    llvm::Align getElementAlign(llvm::Type* elemType) {
+      return module->getDataLayout().getABITypeAlign(elemType);
     }
 
     /**
@@ -280,8 +3010,8 @@ class EvaLLVM {
      * x -> x
      * (x number) -> x
      */
-    std::string extractVarName(const Exp& exp) {
-      return exp.type == ExpType::LIST ? exp.list[0].string : exp.string;
+    Symbol extractVarName(const Exp& exp) {
+      return exp.type == ExpType::LIST ? exp.list[0].symbol : exp.symbol;
     }
 
     /**
@@ -289,21 +3019,48 @@ class EvaLLVM {
      *
      * x -> i32
      * (x number) -> number
+     * (x (array float)) -> array of double
      */
     llvm::Type* extractVarType(const Exp& exp) {
-      return exp.type == ExpType::LIST ? getTypeFromString(exp.list[1].string)
+      return exp.type == ExpType::LIST ? getType(exp.list[1])
         : builder->getInt32Ty();
     }
 
+    /**
+     * Returns LLVM type of a type expression: number, (array float)
+     */
+    llvm::Type* getType(const Exp& type_) {
+      if (type_.type == ExpType::LIST && type_.list.size() == 2 &&
+          type_.list[0].string == "array") {
+        return getArrayType(type_.list[1].string);
+      }
+      return getTypeFromString(type_.string);
+    }
+
     /**
      * Returns LLVM type from string representation
      */
-    llvm::Type* getTypeFromString(const std::string& type_) {
+    llvm::Type* getTypeFromString(std::string_view type_) {
       // number -> i32
-      if (type_ == "number") {
+      if (type_ == "number" || type_ == "i32" || type_ == "u32") {
         return builder->getInt32Ty();
       }
 
+      // i64, u64 -> i64
+      if (type_ == "i64" || type_ == "u64") {
+        return builder->getInt64Ty();
+      }
+
+      // float -> double
+      if (type_ == "float" || type_ == "f64") {
+        return builder->getDoubleTy();
+      }
+
+      // boolean -> i1
+      if (type_ == "boolean") {
+        return builder->getInt1Ty();
+      }
+
       // string -> i8* (aka char*)
       if (type_ == "string") {
         return builder->getInt8Ty()->getPointerTo();
@@ -314,19 +3071,59 @@ class EvaLLVM {
     }
 
     /**
-     * Allocates a local variable on the stack. Result is the alloca instruction.
+     * Whether the type name is of an unsigned integer: u32, u64.
      */
-    llvm::Value* allocVar(const std::string& name, llvm::Type* type_, Env env) {
-      varsBuilder->SetInsertPoint(&fn->getEntryBlock());
+    static bool isUnsignedType(std::string_view type_) {
+      return type_ == "u32" || type_ == "u64";
+    }
 
-      auto varAlloc = varsBuilder->CreateAlloca(type_, 0, name.c_str());
+    /**
+     * Allocates a local variable on the stack. Result is the alloca instruction.
+     */
+    llvm::Value* allocVar(Symbol name, llvm::Type* type_,
+                          bool isUnsigned = false) {
+      // Allocas are prepended to the entry block: it may already be
+      // terminated by a branch.
+      auto& entry = fn->getEntryBlock();
+      varsBuilder->SetInsertPoint(&entry, entry.getFirstInsertionPt());
+
+      auto varAlloc = varsBuilder->CreateAlloca(type_, 0,
+          llvm::StringRef(parser->ast.interner().name(name)));
+
+      if (isUnsigned) {
+        unsigned_.insert(varAlloc);
+      }
 
       // Add to the environment:
-      env->define(name, varAlloc);
+      env.define(name, varAlloc);
 
       return varAlloc;
     }
     
+    /**
+     * Returns a pointer to a string constant (an interned string).
+     *
+     * Constants are pooled: each distinct string is one private
+     * unnamed_addr global of the module, shared by all its uses.
+     */
+    llvm::Constant* getStringPtr(Symbol str) {
+      if (str >= strings_.size()) {
+        strings_.resize(str + 1);
+      }
+
+      auto& ptr = strings_[str];
+      if (ptr == nullptr) {
+        ptr = builder->CreateGlobalStringPtr(
+            llvm::StringRef(parser->ast.interner().name(str)), "",
+            /* address space */ 0, module.get());
+      }
+      return ptr;
+    }
+
+    llvm::Constant* getStringPtr(std::string_view str) {
+      return getStringPtr(parser->ast.interner().intern(str));
+    }
+
     /**
      * Creates a global variable.
      */
@@ -345,28 +3142,23 @@ class EvaLLVM {
      * Define external functions (from libc++)
      */
     void setupExternFunctions() {
-      // i8* to substitute for char*, void*, etc
-      auto bytePtrTy = builder->getInt8Ty()->getPointerTo();
-
       // int printf(const char* format, ...);
-      module->getOrInsertFunction("printf", 
-          llvm::FunctionType::get(
-            /* return type */ builder->getInt32Ty(),
-            /* format arg */ bytePtrTy,
-            /* vararg */ true));
+      // Literal formats are compiled to typed runtime calls.
+      registerForm("printf", [this](const Exp& exp) { return genPrintf(exp); });
     }
 
     /** 
      * Creates a function.
      */
     llvm::Function* createFunction(const std::string& fnName,
-                                    llvm::FunctionType* fnType, Env env) {
+        llvm::FunctionType* fnType,
+        llvm::Function::LinkageTypes linkage = llvm::Function::ExternalLinkage) {
       // Function prototype might already be defined
       auto fn = module->getFunction(fnName);
 
       // If not, allocate the function:
       if (fn == nullptr) {
-        fn = createFunctionProto(fnName, fnType, env);
+        fn = createFunctionProto(fnName, fnType, linkage);
       }
 
       createFunctionBlock(fn);
@@ -378,13 +3170,13 @@ class EvaLLVM {
      * the body)
      */
     llvm::Function* createFunctionProto(const std::string& fnName,
-                                        llvm::FunctionType* fnType, Env env) {
-      auto fn = llvm::Function::Create(fnType, llvm::Function::ExternalLinkage, 
-          fnName, *module);
+        llvm::FunctionType* fnType,
+        llvm::Function::LinkageTypes linkage = llvm::Function::ExternalLinkage) {
+      auto fn = llvm::Function::Create(fnType, linkage, fnName, *module);
       verifyFunction(*fn);
 
       // Install in the environment
-      env->define(fnName, fn);
+      env.define(parser->ast.interner().intern(fnName), fn);
 
       return fn;
     }
@@ -404,7 +3196,7 @@ class EvaLLVM {
      * fn->getBasicBlockList().push_back(block);
      */
     llvm::BasicBlock* createBB(std::string name, llvm::Function* fn = nullptr) {
-      return llvm::BasicBlock::Create(*ctx, name, fn);
+      return llvm::BasicBlock::Create(module->getContext(), name, fn);
     }
 
     /** 
@@ -422,6 +3214,58 @@ class EvaLLVM {
       varsBuilder = std::make_unique<llvm::IRBuilder<>>(*ctx);
     }
 
+    /**
+     * Verifies the module and runs the optimization pipeline on it
+     * (configured for the native target, if any).
+     */
+    void optimize() {
+      if (target) {
+        target->configure(*module);
+      }
+
+      profiler.instructions += module->getInstructionCount();
+      profiler.scopes = env.scopesEntered();
+
+      {
+        auto timer = profiler.time(Phase::Verify);
+        if (llvm::verifyModule(*module, &llvm::errs())) {
+          DIE << "Generated module is broken.\n";
+        }
+      }
+
+      auto timer = profiler.time(Phase::Optimize);
+      EvaOptimizer(options.optLevel, options.timePasses,
+                   target ? target->getTargetMachine() : nullptr)
+          .run(*module);
+    }
+
+    /**
+     * Output file name, or the default one.
+     */
+    std::string getOutput(const std::string& defaultName) {
+      return options.output.empty() ? defaultName : options.output;
+    }
+
+    /**
+     * Hands the module over to the JIT and calls `main`.
+     */
+    int runJIT() {
+      auto jitTimer = profiler.time(Phase::JIT);
+
+      EvaJIT jit(options.jobs);
+      if (options.jobs > 1) {
+        jit.addModule(std::move(module), options.jobs);
+      } else {
+        jit.addModule(std::move(module), std::move(ctx));
+      }
+
+      auto mainFn = jit.lookup<int (*)()>("main");
+      jitTimer.stop();
+
+      auto timer = profiler.time(Phase::Run);
+      return mainFn();
+    }
+
     /** 
      * Saves IR to file.
      */
@@ -431,6 +3275,180 @@ class EvaLLVM {
       module->print(outLL, nullptr);
     }
 
+    /** 
+     * Saves bitcode to file.
+     */
+    void saveModuleToBitcodeFile(const std::string& fileName) {
+      std::error_code errorCode;
+      llvm::raw_fd_ostream outBC(fileName, errorCode);
+      llvm::WriteBitcodeToFile(*module, outBC);
+    }
+
+    /**
+     * Starts a session: the module compiled so far (the global
+     * environment) is its first one, and the context is shared by the
+     * modules of all the forms.
+     */
+    void startSession() {
+      sessionJit_ = std::make_unique<EvaJIT>();
+      sessionContext_ = llvm::orc::ThreadSafeContext(std::move(ctx));
+
+      auto& names = parser->ast.interner();
+
+      for (auto& global : module->globals()) {
+        if (!global.hasLocalLinkage()) {
+          sessionSymbols_[names.intern(global.getName())] = {
+              global.getName().str(), global.getValueType()};
+        }
+      }
+
+      // From now on resolved through the session symbols:
+      env.clear();
+
+      sessionJit_->addModule(std::move(module), sessionContext_);
+    }
+
+    /**
+     * Name of a symbol defined by the current form of the session: "x.3"
+     * (also keeps them apart from the C library ones).
+     */
+    std::string sessionName(Symbol name) {
+      return std::string(parser->ast.interner().name(name)) + "." +
+             std::to_string(sessionForms_);
+    }
+
+    /**
+     * Top-level variable of a session: a global, zero-initialized
+     * (the initializer is stored by the form).
+     */
+    llvm::Value* allocSessionVar(Symbol name, llvm::Type* type_,
+                                 bool isUnsigned) {
+      auto global = createGlobalVar(sessionName(name),
+                                    llvm::Constant::getNullValue(type_));
+      // Natural alignment of the type:
+      global->setAlignment(llvm::MaybeAlign());
+
+      if (isUnsigned) {
+        unsigned_.insert(global);
+      }
+
+      setSessionSymbol(name, {global->getName().str(), type_,
+                              /* isFunction */ false, isUnsigned});
+      return env.define(name, global);
+    }
+
+    /**
+     * Defines a session symbol, the previous one is restored if the form
+     * fails.
+     */
+    void setSessionSymbol(Symbol name, SessionSymbol symbol) {
+      auto entry = sessionSymbols_.find(name);
+      sessionUndo_.symbols.emplace_back(
+          name, entry != sessionSymbols_.end()
+                    ? std::optional<SessionSymbol>(entry->second)
+                    : std::nullopt);
+      sessionSymbols_[name] = std::move(symbol);
+    }
+
+    /**
+     * Declares a global or a function of a previous form in the current
+     * module, and binds it in the current scope. Returns null if the
+     * session has no such symbol.
+     */
+    llvm::Value* declareSessionSymbol(Symbol name) {
+      auto entry = sessionSymbols_.find(name);
+      if (entry == sessionSymbols_.end()) {
+        return nullptr;
+      }
+
+      const auto& symbol = entry->second;
+      if (symbol.isFunction) {
+        return env.define(name, getSessionFunction(name));
+      }
+
+      module->getOrInsertGlobal(symbol.name, symbol.type);
+      auto global = module->getNamedGlobal(symbol.name);
+      if (symbol.isUnsigned) {
+        unsigned_.insert(global);
+      }
+      return env.define(name, global);
+    }
+
+    /**
+     * Returns the latest definition of a session function, declared in
+     * the current module if it is defined by another one.
+     */
+    llvm::Function* getSessionFunction(Symbol name) {
+      const auto& symbol = sessionSymbols_.at(name);
+
+      auto callee = module->getFunction(symbol.name);
+      if (callee == nullptr) {
+        callee = llvm::Function::Create(
+            llvm::cast<llvm::FunctionType>(symbol.type),
+            llvm::Function::ExternalLinkage, symbol.name, *module);
+        callee->setCallingConv(llvm::CallingConv::Fast);
+      }
+
+      if (symbol.isUnsigned) {
+        unsigned_.insert(callee);
+      }
+      return callee;
+    }
+
+    /**
+     * Whether the value of a session form is printed: atoms, arithmetic,
+     * `if`, array reads and calls of the session functions (but the
+     * async ones, which have no result).
+     */
+    bool isSessionExpression(const Exp& exp) {
+      if (exp.type != ExpType::LIST) {
+        return true;
+      }
+      if (exp.list.size() == 0 || exp.list[0].type != ExpType::SYMBOL) {
+        return false;
+      }
+
+      auto tag = exp.list[0].symbol;
+      if (isBinaryOp(tag) || tag == OP_IF || tag == OP_GET || tag == OP_LEN ||
+          tag == OP_VSUM) {
+        return true;
+      }
+
+      auto entry = sessionSymbols_.find(tag);
+      return entry != sessionSymbols_.end() && entry->second.isFunction &&
+             !llvm::cast<llvm::FunctionType>(entry->second.type)
+                  ->getReturnType()
+                  ->isVoidTy();
+    }
+
+    /**
+     * Prints a boolean, number or string value, on its own line.
+     */
+    void printValue(llvm::Value* value) {
+      auto type = value->getType();
+      const char* format;
+
+      if (type->isIntegerTy(1)) {
+        format = "%s\n";
+        value = builder->CreateSelect(value, getStringPtr("true"),
+                                      getStringPtr("false"));
+      } else if (type->isIntegerTy(32)) {
+        format = isUnsigned(value) ? "%u\n" : "%d\n";
+      } else if (type->isIntegerTy(64)) {
+        format = isUnsigned(value) ? "%lu\n" : "%ld\n";
+      } else if (type->isDoubleTy()) {
+        format = "%g\n";
+      } else if (type == builder->getInt8Ty()->getPointerTo()) {
+        format = "%s\n";
+      } else {
+        return;
+      }
+
+      auto printfFn = module->getOrInsertFunction(
+          "printf", EvaRuntime::getPrintfType(module->getContext()));
+      builder->CreateCall(printfFn, {getStringPtr(format), value});
+    }
+
     /**
      * Sets up The Global Environment
      */
@@ -439,25 +3457,107 @@ class EvaLLVM {
         {"VERSION", builder->getInt32(42)},
       };
 
-      std::map<std::string, llvm::Value*> globalRec{};
+      auto& names = parser->ast.interner();
 
       for (auto& entry : globalObject) {
-        globalRec[entry.first] = 
-          createGlobalVar(entry.first, (llvm::Constant*)entry.second);
+        env.define(names.intern(entry.first),
+          createGlobalVar(entry.first, (llvm::Constant*)entry.second));
       }
-
-      GlobalEnv = std::make_shared<Environment>(globalRec, nullptr);
     }
 
+    /**
+     * Compiler options.
+     */
+    EvaOptions options;
+
+    /**
+     * Native target, set up for the Object and Executable modes.
+     */
+    std::unique_ptr<EvaTarget> target;
+
+    /**
+     * Compilation cache, and the key of the current program.
+     */
+    std::unique_ptr<EvaCache> cache;
+    std::string cacheKey;
+
+    /**
+     * Session JIT, its globals and functions, and the number of forms
+     * run (see `evalForm`).
+     */
+    std::unique_ptr<EvaJIT> sessionJit_;
+    std::unordered_map<Symbol, SessionSymbol> sessionSymbols_;
+    size_t sessionForms_ = 0;
+
+    /**
+     * Changes of the session by the current form.
+     */
+    SessionUndo sessionUndo_;
+
+    /**
+     * Mapped source file, the parsed values refer to its text.
+     */
+    std::unique_ptr<llvm::MemoryBuffer> source;
+
+    /**
+     * Compile-time profiler.
+     */
+    EvaProfiler profiler;
+
     /**
      * Parser.
      */
     std::unique_ptr<EvaParser> parser;
 
     /**
-     * Global Environment (symbol table).
+     * Text of the last parse, the list offsets of its AST refer to it.
+     */
+    std::string_view parsedText_;
+
+    /**
+     * Environment (symbol table): globals and the open block scopes.
+     */
+    Environment env;
+
+    /**
+     * Special forms handlers, indexed by the symbol of the form name.
+     */
+    std::vector<FormHandler> forms_;
+
+    /**
+     * String constants of the module, indexed by the interned string
+     * (null if not used yet).
+     */
+    std::vector<llvm::Constant*> strings_;
+
+    /**
+     * Heap arrays of the current function allocated on its stack.
+     */
+    StackArrays stackArrays_;
+
+    /**
+     * Coroutine of the current (async) function, and whether an async
+     * function was defined.
+     */
+    Coroutine coro_;
+    bool asyncDefined_ = false;
+
+    /**
+     * SIMD register size in bits, 0 till first needed.
+     */
+    unsigned vectorBits_ = 0;
+
+    /**
+     * Names of the elementwise operations, by the scalar opcode.
+     */
+    static constexpr const char* vectorOpNames_[] = {"vadd", "vsub", "vmul",
+                                                     "vdiv"};
+
+    /**
+     * Unsigned integer values, and the unsigned variables (LLVM integer
+     * types have no sign).
      */
-    std::shared_ptr<Environment> GlobalEnv;
+    std::unordered_set<const llvm::Value*> unsigned_;
 
     /**
      * Currently compiling function.
@@ -470,6 +3570,12 @@ class EvaLLVM {
      * infrastructure, including the types and constant unique tables.
      */
     std::unique_ptr<llvm::LLVMContext> ctx;
+
+    /**
+     * Context shared by the modules of a session (`ctx` is moved into it
+     * when the session starts).
+     */
+    llvm::orc::ThreadSafeContext sessionContext_;
     
     /**
      * A module instance is used to store all the information related to an 
@@ -0,0 +1,119 @@
+/**
+ * Optimization pipeline over the generated module.
+ */
+#ifndef EvaOptimizer_h
+#define EvaOptimizer_h
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Coroutines/CoroCleanup.h"
+#include "llvm/Transforms/Coroutines/CoroEarly.h"
+#include "llvm/Transforms/Coroutines/CoroSplit.h"
+
+/**
+ * Runs the standard new PassManager pipeline of the given level:
+ *
+ * O0 - always-inline only
+ * O1 - mem2reg/SROA, instcombine, simplifycfg, early CSE
+ * O2 - plus GVN, inlining, loop rotation/unrolling/vectorization
+ * O3 - plus aggressive inlining and argument promotion
+ *
+ * Coroutines (async functions) are split into their ramp, resume and
+ * destroy functions at every level.
+ */
+class EvaOptimizer {
+  public:
+    /**
+     * The target machine (if given) exposes the target cost model
+     * to the passes. With `timePasses` the time of each pass is
+     * reported to stderr.
+     */
+    EvaOptimizer(unsigned optLevel, bool timePasses,
+                 llvm::TargetMachine* targetMachine = nullptr)
+      : optLevel_(optLevel),
+        timePasses_(timePasses),
+        targetMachine_(targetMachine) {}
+
+    /**
+     * Optimizes the module in place.
+     */
+    void run(llvm::Module& module) {
+      llvm::LoopAnalysisManager LAM;
+      llvm::FunctionAnalysisManager FAM;
+      llvm::CGSCCAnalysisManager CGAM;
+      llvm::ModuleAnalysisManager MAM;
+
+      // Per-pass timers, printed when the handler goes out of scope.
+      llvm::PassInstrumentationCallbacks PIC;
+      llvm::TimePassesHandler timer(timePasses_);
+      timer.setOutStream(llvm::errs());
+      timer.registerCallbacks(PIC);
+
+      llvm::PassBuilder PB(targetMachine_, llvm::PipelineTuningOptions(),
+                           llvm::None, &PIC);
+
+      PB.registerModuleAnalyses(MAM);
+      PB.registerCGSCCAnalyses(CGAM);
+      PB.registerFunctionAnalyses(FAM);
+      PB.registerLoopAnalyses(LAM);
+      PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+      auto level = getOptimizationLevel();
+
+      auto MPM = level == llvm::OptimizationLevel::O0
+                     ? PB.buildO0DefaultPipeline(level)
+                     : PB.buildPerModuleDefaultPipeline(level);
+
+      // The O0 pipeline leaves the coroutines unsplit, which the code
+      // generator can't lower.
+      if (level == llvm::OptimizationLevel::O0) {
+        addCoroutinePasses(MPM);
+      }
+
+      MPM.run(module, MAM);
+    }
+
+  private:
+    void addCoroutinePasses(llvm::ModulePassManager& MPM) {
+      MPM.addPass(
+          llvm::createModuleToFunctionPassAdaptor(llvm::CoroEarlyPass()));
+      MPM.addPass(llvm::createModuleToPostOrderCGSCCPassAdaptor(
+          llvm::CoroSplitPass()));
+      MPM.addPass(
+          llvm::createModuleToFunctionPassAdaptor(llvm::CoroCleanupPass()));
+    }
+
+    llvm::OptimizationLevel getOptimizationLevel() {
+      switch (optLevel_) {
+        case 0:
+          return llvm::OptimizationLevel::O0;
+        case 1:
+          return llvm::OptimizationLevel::O1;
+        case 2:
+          return llvm::OptimizationLevel::O2;
+        default:
+          return llvm::OptimizationLevel::O3;
+      }
+    }
+
+    /**
+     * Optimization level: 0-3.
+     */
+    unsigned optLevel_;
+
+    /**
+     * Whether to report the time of each pass.
+     */
+    bool timePasses_;
+
+    /**
+     * Target machine, may be null.
+     */
+    llvm::TargetMachine* targetMachine_;
+};
+
+#endif//EvaOptimizer_h
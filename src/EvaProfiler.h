@@ -0,0 +1,186 @@
+/**
+ * Compile-time phase profiler.
+ */
+#ifndef EvaProfiler_h
+#define EvaProfiler_h
+
+#include <stdint.h>
+#include <array>
+#include <chrono>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+/**
+ * Compiler phases.
+ */
+enum class Phase {
+  Tokenize,
+  Parse,
+  Gen,
+  Verify,
+  Optimize,
+  Emit,
+  JIT,
+  Run,
+  COUNT,
+};
+
+/**
+ * Phase profiler: accumulates the time spent in each phase, and counts
+ * the work done. When disabled, timers don't read the clock.
+ */
+class EvaProfiler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Scoped timer of a phase.
+     */
+    class Timer {
+      public:
+        Timer(EvaProfiler& profiler, Phase phase)
+          : profiler_(profiler), phase_(phase) {
+          if (profiler_.enabled) {
+            start_ = Clock::now();
+          }
+        }
+
+        ~Timer() { stop(); }
+
+        /**
+         * Stops the timer before the end of the scope.
+         */
+        void stop() {
+          if (profiler_.enabled && !stopped_) {
+            profiler_.add(phase_, Clock::now() - start_);
+          }
+          stopped_ = true;
+        }
+
+      private:
+        EvaProfiler& profiler_;
+        Phase phase_;
+        Clock::time_point start_;
+        bool stopped_ = false;
+    };
+
+    explicit EvaProfiler(bool enabled) : enabled(enabled) {
+      heapAtStart_ = getHeapInUse();
+    }
+
+    /**
+     * Times the phase till the end of the scope.
+     */
+    Timer time(Phase phase) { return Timer(*this, phase); }
+
+    /**
+     * Adds time to a phase.
+     */
+    void add(Phase phase, Clock::duration duration) {
+      times_[(int)phase] += duration;
+    }
+
+    /**
+     * Prints the report as a table.
+     */
+    void printTable(llvm::raw_ostream& out) {
+      auto total = getTotal();
+
+      out << "===-------------------------------------------===\n"
+          << "              Eva compile-time report\n"
+          << "===-------------------------------------------===\n"
+          << "   Phase          Time (ms)      %\n";
+
+      for (auto i = 0; i < (int)Phase::COUNT; i++) {
+        auto ms = toMs(times_[i]);
+        out << llvm::format("   %-12s %11.3f %6.1f%%\n", phaseNames_[i], ms,
+                            total > 0 ? ms * 100 / total : 0.0);
+      }
+
+      out << llvm::format("   Total        %11.3f\n\n", total);
+
+      out << llvm::format("   Tokens               %16llu\n",
+                          (unsigned long long)tokens)
+          << llvm::format("   AST nodes            %16llu\n",
+                          (unsigned long long)astNodes)
+          << llvm::format("   Scopes               %16llu\n",
+                          (unsigned long long)scopes)
+          << llvm::format("   Instructions emitted %16llu\n",
+                          (unsigned long long)instructions)
+          << llvm::format("   Heap bytes (growth)  %16lld\n",
+                          (long long)getHeapGrowth());
+    }
+
+    /**
+     * Prints the report as JSON.
+     */
+    void printJSON(llvm::raw_ostream& out) {
+      out << "{\"phases_ms\": {";
+      for (auto i = 0; i < (int)Phase::COUNT; i++) {
+        out << (i > 0 ? ", " : "") << "\"" << phaseNames_[i]
+            << "\": " << llvm::format("%.3f", toMs(times_[i]));
+      }
+      out << "}, \"total_ms\": " << llvm::format("%.3f", getTotal())
+          << ", \"counters\": {"
+          << "\"tokens\": " << tokens
+          << ", \"ast_nodes\": " << astNodes
+          << ", \"scopes\": " << scopes
+          << ", \"instructions\": " << instructions
+          << ", \"heap_bytes\": " << getHeapGrowth() << "}}\n";
+    }
+
+    /**
+     * Whether the profiling is on.
+     */
+    const bool enabled;
+
+    /**
+     * Counters.
+     */
+    uint64_t tokens = 0;
+    uint64_t astNodes = 0;
+    uint64_t scopes = 0;
+    uint64_t instructions = 0;
+
+  private:
+    static double toMs(Clock::duration duration) {
+      return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    double getTotal() {
+      auto total = 0.0;
+      for (auto& time : times_) {
+        total += toMs(time);
+      }
+      return total;
+    }
+
+    /**
+     * Heap bytes in use (0 if not supported).
+     */
+    static int64_t getHeapInUse() {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+      auto info = mallinfo2();
+      return (int64_t)(info.uordblks + info.hblkhd);
+#else
+      return 0;
+#endif
+    }
+
+    int64_t getHeapGrowth() { return getHeapInUse() - heapAtStart_; }
+
+    static constexpr const char* phaseNames_[(int)Phase::COUNT] = {
+        "tokenize", "parse", "gen", "verify", "optimize", "emit", "jit", "run",
+    };
+
+    std::array<Clock::duration, (int)Phase::COUNT> times_{};
+
+    int64_t heapAtStart_;
+};
+
+#endif//EvaProfiler_h
@@ -0,0 +1,893 @@
+/**
+ * Runtime library of the compiled programs: buffered typed output, the
+ * arena heap, and the event loop of the async functions.
+ */
+#ifndef EvaRuntime_h
+#define EvaRuntime_h
+
+#include <stdint.h>
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Host.h"
+
+/**
+ * Output runtime, emitted as IR into the module on first use: there is
+ * nothing to link, the same for `lli`, the JIT and native executables.
+ *
+ *   i32 eva.print_i32(i32)
+ *   i32 eva.print_i64(i64)
+ *   i32 eva.print_u64(i64)
+ *   i32 eva.print_str(i8*)
+ *   i32 eva.print_bytes(i8*, i64)
+ *   void eva.flush()
+ *   void eva.write(i8*, i64)
+ *
+ * The print functions format into an output buffer (no format string
+ * parsing), and return the number of bytes written. A full buffer is
+ * written at once to fd 1 after the C library buffers are flushed, so
+ * it keeps the order of the plain `printf` calls, provided the buffer
+ * is flushed before them.
+ *
+ *   i8* eva.arena_alloc(i64 size)
+ *   i8* eva.arena_mark()
+ *   void eva.arena_reset(i8* mark)
+ *
+ * The arena is a bump-pointer heap: an allocation moves the top of the
+ * current chunk (1 MiB, or larger for a large object), and a new chunk
+ * is taken from malloc when it is full. Objects are not freed one by
+ * one: a region is released at once by resetting the top to a mark
+ * taken before it, which also frees the chunks allocated since.
+ *
+ *   i32 eva.sleep_fd(i32 ms)
+ *   void eva.await_fd(i8* coroutine, i32 fd, i1 once)
+ *   void eva.loop_run()
+ *
+ * The event loop (Linux epoll) resumes suspended coroutines when the
+ * file descriptor they wait for is readable: a timer (timerfd, closed
+ * once fired) or a pipe. One coroutine waits for a descriptor at a
+ * time: waiting for one already waited for (or for one epoll doesn't
+ * support, e.g. a regular file) is a run-time error, which exits the
+ * program. The loop runs till no coroutine is waiting.
+ *
+ * Eva programs are single-threaded: the buffer, the arena and the loop
+ * are plain globals.
+ */
+class EvaRuntime {
+  public:
+    /**
+     * Runtime of the module, with the linkage of its functions and buffer
+     * (internal, or linkonce_odr when shared by modules of a session).
+     */
+    EvaRuntime(llvm::Module& module, llvm::GlobalValue::LinkageTypes linkage)
+      : module_(module), linkage_(linkage), builder_(module.getContext()) {}
+
+    /**
+     * Whether the module uses the runtime (then it should be flushed
+     * before the program exits).
+     */
+    bool isUsed() const { return module_.getFunction("eva.flush") != nullptr; }
+
+    /**
+     * void eva.flush(): writes the buffered output to the output file,
+     * after the output of the C library (fflush of its buffers).
+     */
+    llvm::Function* flush() {
+      if (auto fn = module_.getFunction("eva.flush")) {
+        return fn;
+      }
+
+      auto writeFn = write();
+      auto fn = createFunction("eva.flush", builder_.getVoidTy(), {});
+      auto writeBB = createBB("write", fn);
+      auto done = createBB("done", fn);
+
+      auto length = builder_.CreateLoad(builder_.getInt64Ty(), getLength());
+      builder_.CreateCondBr(
+          builder_.CreateICmpNE(length, builder_.getInt64(0)), writeBB, done);
+
+      builder_.SetInsertPoint(writeBB);
+      builder_.CreateCall(getFflush(),
+                          {llvm::ConstantPointerNull::get(getBytePtrTy())});
+      builder_.CreateCall(writeFn, {getBuffer(builder_.getInt64(0)), length});
+      builder_.CreateStore(builder_.getInt64(0), getLength());
+      builder_.CreateBr(done);
+
+      builder_.SetInsertPoint(done);
+      builder_.CreateRetVoid();
+      return fn;
+    }
+
+    /**
+     * void eva.write(i8* bytes, i64 size): writes to the standard output
+     * (fd 1), unbuffered, resuming short writes. Stops on an error.
+     */
+    llvm::Function* write() {
+      if (auto fn = module_.getFunction("eva.write")) {
+        return fn;
+      }
+
+      auto i64Ty = builder_.getInt64Ty();
+      auto writeFn = module_.getOrInsertFunction(
+          "write", i64Ty, builder_.getInt32Ty(), getBytePtrTy(), i64Ty);
+
+      auto fn = createFunction("eva.write", builder_.getVoidTy(),
+                               {getBytePtrTy(), i64Ty});
+      auto entry = builder_.GetInsertBlock();
+      auto loop = createBB("loop", fn);
+      auto more = createBB("more", fn);
+      auto done = createBB("done", fn);
+      builder_.CreateBr(loop);
+
+      builder_.SetInsertPoint(loop);
+      auto bytes = builder_.CreatePHI(getBytePtrTy(), 2, "bytes");
+      auto size = builder_.CreatePHI(i64Ty, 2, "size");
+      bytes->addIncoming(fn->getArg(0), entry);
+      size->addIncoming(fn->getArg(1), entry);
+
+      auto written =
+          builder_.CreateCall(writeFn, {builder_.getInt32(1), bytes, size});
+      builder_.CreateCondBr(
+          builder_.CreateICmpSGT(written, builder_.getInt64(0)), more, done);
+
+      builder_.SetInsertPoint(more);
+      auto rest = builder_.CreateSub(size, written);
+      bytes->addIncoming(
+          builder_.CreateInBoundsGEP(builder_.getInt8Ty(), bytes, written),
+          more);
+      size->addIncoming(rest, more);
+      builder_.CreateCondBr(builder_.CreateICmpNE(rest, builder_.getInt64(0)),
+                            loop, done);
+
+      builder_.SetInsertPoint(done);
+      builder_.CreateRetVoid();
+      return fn;
+    }
+
+    /**
+     * i32 eva.print_bytes(i8* bytes, i64 size)
+     */
+    llvm::Function* printBytes() {
+      if (auto fn = module_.getFunction("eva.print_bytes")) {
+        return fn;
+      }
+
+      auto flushFn = flush();
+      auto writeFn = write();
+      auto fn = createFunction("eva.print_bytes", builder_.getInt32Ty(),
+                               {getBytePtrTy(), builder_.getInt64Ty()});
+      auto bytes = fn->getArg(0);
+      auto size = fn->getArg(1);
+
+      auto full = createBB("full", fn);
+      auto direct = createBB("direct", fn);
+      auto copy = createBB("copy", fn);
+
+      // Flush if it doesn't fit:
+      auto length = builder_.CreateLoad(builder_.getInt64Ty(), getLength());
+      auto fits = builder_.CreateICmpULE(builder_.CreateAdd(length, size),
+                                         builder_.getInt64(CAPACITY));
+      builder_.CreateCondBr(fits, copy, full);
+
+      // Larger than the buffer: written directly.
+      builder_.SetInsertPoint(full);
+      builder_.CreateCall(flushFn);
+      builder_.CreateCondBr(
+          builder_.CreateICmpUGT(size, builder_.getInt64(CAPACITY)), direct,
+          copy);
+
+      builder_.SetInsertPoint(direct);
+      builder_.CreateCall(writeFn, {bytes, size});
+      builder_.CreateRet(builder_.CreateTrunc(size, builder_.getInt32Ty()));
+
+      builder_.SetInsertPoint(copy);
+      length = builder_.CreateLoad(builder_.getInt64Ty(), getLength());
+      builder_.CreateMemCpy(getBuffer(length), llvm::MaybeAlign(1), bytes,
+                            llvm::MaybeAlign(1), size);
+      builder_.CreateStore(builder_.CreateAdd(length, size), getLength());
+      builder_.CreateRet(builder_.CreateTrunc(size, builder_.getInt32Ty()));
+      return fn;
+    }
+
+    /**
+     * i32 eva.print_str(i8* str)
+     */
+    llvm::Function* printStr() {
+      if (auto fn = module_.getFunction("eva.print_str")) {
+        return fn;
+      }
+
+      auto printBytesFn = printBytes();
+      auto strlenFn = module_.getOrInsertFunction(
+          "strlen", builder_.getInt64Ty(), getBytePtrTy());
+
+      auto fn = createFunction("eva.print_str", builder_.getInt32Ty(),
+                               {getBytePtrTy()});
+      auto size = builder_.CreateCall(strlenFn, {fn->getArg(0)});
+      builder_.CreateRet(
+          builder_.CreateCall(printBytesFn, {fn->getArg(0), size}));
+      return fn;
+    }
+
+    /**
+     * i32 eva.print_u64(i64 value): decimal digits of an unsigned value.
+     */
+    llvm::Function* printU64() {
+      if (auto fn = module_.getFunction("eva.print_u64")) {
+        return fn;
+      }
+
+      auto printBytesFn = printBytes();
+      auto fn = createFunction("eva.print_u64", builder_.getInt32Ty(),
+                               {builder_.getInt64Ty()});
+      auto entry = builder_.GetInsertBlock();
+      auto loop = createBB("loop", fn);
+      auto done = createBB("done", fn);
+
+      // Digits are written backwards, at the end of a local buffer:
+      auto digitsTy = llvm::ArrayType::get(builder_.getInt8Ty(), MAX_DIGITS);
+      auto digits = builder_.CreateAlloca(digitsTy, nullptr, "digits");
+      builder_.CreateBr(loop);
+
+      builder_.SetInsertPoint(loop);
+      auto index = builder_.CreatePHI(builder_.getInt64Ty(), 2, "i");
+      auto value = builder_.CreatePHI(builder_.getInt64Ty(), 2, "value");
+      auto ten = builder_.getInt64(10);
+      auto quotient = builder_.CreateUDiv(value, ten);
+      auto digit = builder_.CreateAdd(
+          builder_.CreateTrunc(builder_.CreateURem(value, ten),
+                               builder_.getInt8Ty()),
+          builder_.getInt8('0'));
+      auto next = builder_.CreateSub(index, builder_.getInt64(1));
+      builder_.CreateStore(digit, builder_.CreateInBoundsGEP(
+                                      digitsTy, digits,
+                                      {builder_.getInt64(0), next}));
+      builder_.CreateCondBr(
+          builder_.CreateICmpNE(quotient, builder_.getInt64(0)), loop, done);
+
+      index->addIncoming(builder_.getInt64(MAX_DIGITS), entry);
+      index->addIncoming(next, loop);
+      value->addIncoming(fn->getArg(0), entry);
+      value->addIncoming(quotient, loop);
+
+      builder_.SetInsertPoint(done);
+      auto first = builder_.CreateInBoundsGEP(digitsTy, digits,
+                                              {builder_.getInt64(0), next});
+      builder_.CreateRet(builder_.CreateCall(
+          printBytesFn,
+          {first, builder_.CreateSub(builder_.getInt64(MAX_DIGITS), next)}));
+      return fn;
+    }
+
+    /**
+     * i32 eva.print_i64(i64 value)
+     */
+    llvm::Function* printI64() {
+      if (auto fn = module_.getFunction("eva.print_i64")) {
+        return fn;
+      }
+
+      auto printBytesFn = printBytes();
+      auto printU64Fn = printU64();
+      auto fn = createFunction("eva.print_i64", builder_.getInt32Ty(),
+                               {builder_.getInt64Ty()});
+      auto value = fn->getArg(0);
+
+      auto entry = builder_.GetInsertBlock();
+      auto minus = createBB("minus", fn);
+      auto digits = createBB("digits", fn);
+
+      auto isNegative = builder_.CreateICmpSLT(value, builder_.getInt64(0));
+      // Wraps for INT64_MIN, printed as unsigned:
+      auto magnitude = builder_.CreateSelect(
+          isNegative, builder_.CreateNeg(value), value);
+      builder_.CreateCondBr(isNegative, minus, digits);
+
+      builder_.SetInsertPoint(minus);
+      builder_.CreateCall(printBytesFn, {getString("eva.str.minus", "-"),
+                                         builder_.getInt64(1)});
+      builder_.CreateBr(digits);
+
+      builder_.SetInsertPoint(digits);
+      auto sign = builder_.CreatePHI(builder_.getInt32Ty(), 2);
+      sign->addIncoming(builder_.getInt32(1), minus);
+      sign->addIncoming(builder_.getInt32(0), entry);
+      builder_.CreateRet(builder_.CreateAdd(
+          sign, builder_.CreateCall(printU64Fn, {magnitude})));
+      return fn;
+    }
+
+    /**
+     * i32 eva.print_i32(i32 value)
+     */
+    llvm::Function* printI32() {
+      if (auto fn = module_.getFunction("eva.print_i32")) {
+        return fn;
+      }
+
+      auto printI64Fn = printI64();
+      auto fn = createFunction("eva.print_i32", builder_.getInt32Ty(),
+                               {builder_.getInt32Ty()});
+      builder_.CreateRet(builder_.CreateCall(
+          printI64Fn,
+          {builder_.CreateSExt(fn->getArg(0), builder_.getInt64Ty())}));
+      return fn;
+    }
+
+    /**
+     * i8* eva.arena_alloc(i64 size): uninitialized memory, 16 bytes
+     * aligned.
+     */
+    llvm::Function* arenaAlloc() {
+      if (auto fn = module_.getFunction("eva.arena_alloc")) {
+        return fn;
+      }
+
+      auto i64Ty = builder_.getInt64Ty();
+      auto fn = createFunction("eva.arena_alloc", getBytePtrTy(), {i64Ty});
+      auto bump = createBB("bump", fn);
+      auto grow = createBB("grow", fn);
+
+      // size = (size + 15) & ~15
+      auto size = builder_.CreateAnd(
+          builder_.CreateAdd(fn->getArg(0), builder_.getInt64(ARENA_ALIGN - 1)),
+          builder_.getInt64(~(ARENA_ALIGN - 1)));
+
+      // Bump the top if the object fits the chunk:
+      auto top = builder_.CreateLoad(getBytePtrTy(), getArenaTop());
+      auto end = builder_.CreateLoad(getBytePtrTy(), getArenaEnd());
+      auto newTop = builder_.CreateGEP(builder_.getInt8Ty(), top, size);
+      auto fits = builder_.CreateAnd(
+          builder_.CreateIsNotNull(top), builder_.CreateICmpULE(newTop, end));
+      builder_.CreateCondBr(fits, bump, grow);
+
+      builder_.SetInsertPoint(bump);
+      builder_.CreateStore(newTop, getArenaTop());
+      builder_.CreateRet(top);
+
+      // New chunk: [prev chunk, end] header, and the data.
+      builder_.SetInsertPoint(grow);
+      auto chunkSize = builder_.CreateAdd(
+          builder_.CreateBinaryIntrinsic(llvm::Intrinsic::umax, size,
+                                         builder_.getInt64(ARENA_CHUNK)),
+          builder_.getInt64(ARENA_HEADER));
+      auto mallocFn =
+          module_.getOrInsertFunction("malloc", getBytePtrTy(), i64Ty);
+      auto chunk = builder_.CreateCall(mallocFn, {chunkSize}, "chunk");
+      auto chunkEnd = builder_.CreateGEP(builder_.getInt8Ty(), chunk, chunkSize);
+
+      auto header = builder_.CreateBitCast(
+          chunk, getBytePtrTy()->getPointerTo(), "header");
+      builder_.CreateStore(
+          builder_.CreateLoad(getBytePtrTy(), getArenaChunk()), header);
+      builder_.CreateStore(
+          chunkEnd, builder_.CreateConstGEP1_64(getBytePtrTy(), header, 1));
+      builder_.CreateStore(chunk, getArenaChunk());
+
+      auto data =
+          builder_.CreateConstGEP1_64(builder_.getInt8Ty(), chunk, ARENA_HEADER);
+      builder_.CreateStore(builder_.CreateGEP(builder_.getInt8Ty(), data, size),
+                           getArenaTop());
+      builder_.CreateStore(chunkEnd, getArenaEnd());
+      builder_.CreateRet(data);
+      return fn;
+    }
+
+    /**
+     * i8* eva.arena_mark(): the current top of the arena.
+     */
+    llvm::Function* arenaMark() {
+      if (auto fn = module_.getFunction("eva.arena_mark")) {
+        return fn;
+      }
+
+      auto fn = createFunction("eva.arena_mark", getBytePtrTy(), {});
+      builder_.CreateRet(builder_.CreateLoad(getBytePtrTy(), getArenaTop()));
+      return fn;
+    }
+
+    /**
+     * void eva.arena_reset(i8* mark): releases the objects allocated
+     * since the mark was taken (all of them for a null mark).
+     */
+    llvm::Function* arenaReset() {
+      if (auto fn = module_.getFunction("eva.arena_reset")) {
+        return fn;
+      }
+
+      auto fn = createFunction("eva.arena_reset", builder_.getVoidTy(),
+                               {getBytePtrTy()});
+      auto mark = fn->getArg(0);
+      auto loop = createBB("loop", fn);
+      auto check = createBB("check", fn);
+      auto release = createBB("release", fn);
+      auto found = createBB("found", fn);
+      auto empty = createBB("empty", fn);
+      builder_.CreateBr(loop);
+
+      // Chunks from the newest, till the one of the mark:
+      builder_.SetInsertPoint(loop);
+      auto chunk = builder_.CreateLoad(getBytePtrTy(), getArenaChunk(), "chunk");
+      builder_.CreateCondBr(builder_.CreateIsNull(chunk), empty, check);
+
+      builder_.SetInsertPoint(check);
+      auto header = builder_.CreateBitCast(
+          chunk, getBytePtrTy()->getPointerTo(), "header");
+      auto endPtr = builder_.CreateConstGEP1_64(getBytePtrTy(), header, 1);
+      auto chunkEnd = builder_.CreateLoad(getBytePtrTy(), endPtr, "end");
+      auto data =
+          builder_.CreateConstGEP1_64(builder_.getInt8Ty(), chunk, ARENA_HEADER);
+      auto inChunk = builder_.CreateAnd(builder_.CreateICmpUGE(mark, data),
+                                        builder_.CreateICmpULE(mark, chunkEnd));
+      builder_.CreateCondBr(inChunk, found, release);
+
+      builder_.SetInsertPoint(release);
+      builder_.CreateStore(builder_.CreateLoad(getBytePtrTy(), header),
+                           getArenaChunk());
+      auto freeFn = module_.getOrInsertFunction("free", builder_.getVoidTy(),
+                                                getBytePtrTy());
+      builder_.CreateCall(freeFn, {chunk});
+      builder_.CreateBr(loop);
+
+      builder_.SetInsertPoint(found);
+      builder_.CreateStore(mark, getArenaTop());
+      builder_.CreateStore(chunkEnd, getArenaEnd());
+      builder_.CreateRetVoid();
+
+      // All the chunks are released:
+      builder_.SetInsertPoint(empty);
+      auto null = llvm::ConstantPointerNull::get(getBytePtrTy());
+      builder_.CreateStore(null, getArenaTop());
+      builder_.CreateStore(null, getArenaEnd());
+      builder_.CreateRetVoid();
+      return fn;
+    }
+
+    /**
+     * Whether the module waits for events (then it should run the loop
+     * before the program exits).
+     */
+    bool isLoopUsed() const {
+      return module_.getFunction("eva.await_fd") != nullptr;
+    }
+
+    /**
+     * i32 eva.sleep_fd(i32 ms): a timer descriptor, readable in `ms`
+     * milliseconds.
+     */
+    llvm::Function* sleepFd() {
+      if (auto fn = module_.getFunction("eva.sleep_fd")) {
+        return fn;
+      }
+
+      auto i32Ty = builder_.getInt32Ty();
+      auto i64Ty = builder_.getInt64Ty();
+      auto fn = createFunction("eva.sleep_fd", i32Ty, {i32Ty});
+
+      // timerfd_create(CLOCK_MONOTONIC, 0)
+      auto timerfdCreate = module_.getOrInsertFunction("timerfd_create", i32Ty,
+                                                       i32Ty, i32Ty);
+      auto timer = builder_.CreateCall(
+          timerfdCreate,
+          {builder_.getInt32(CLOCK_MONOTONIC_), builder_.getInt32(0)}, "timer");
+
+      // Expiration: struct itimerspec {interval, value} of timespecs, a
+      // zero one would disarm the timer.
+      auto ns = builder_.CreateMul(builder_.CreateSExt(fn->getArg(0), i64Ty),
+                                   builder_.getInt64(1000000));
+      ns = builder_.CreateSelect(
+          builder_.CreateICmpSGT(ns, builder_.getInt64(0)), ns,
+          builder_.getInt64(1));
+
+      auto specTy = llvm::ArrayType::get(i64Ty, 4);
+      auto spec = builder_.CreateAlloca(specTy, nullptr, "spec");
+      auto billion = builder_.getInt64(1000000000);
+      llvm::Value* fields[] = {builder_.getInt64(0), builder_.getInt64(0),
+                               builder_.CreateUDiv(ns, billion),
+                               builder_.CreateURem(ns, billion)};
+      for (auto i = 0; i < 4; i++) {
+        builder_.CreateStore(fields[i], builder_.CreateConstInBoundsGEP2_64(
+                                            specTy, spec, 0, i));
+      }
+
+      auto timerfdSettime = module_.getOrInsertFunction(
+          "timerfd_settime", i32Ty, i32Ty, i32Ty, getBytePtrTy(),
+          getBytePtrTy());
+      builder_.CreateCall(
+          timerfdSettime,
+          {timer, builder_.getInt32(0),
+           builder_.CreateBitCast(spec, getBytePtrTy()),
+           llvm::ConstantPointerNull::get(getBytePtrTy())});
+      builder_.CreateRet(timer);
+      return fn;
+    }
+
+    /**
+     * void eva.await_fd(i8* coroutine, i32 fd, i1 once): resumes the
+     * suspended coroutine when `fd` is readable, and closes a `once`
+     * descriptor then.
+     */
+    llvm::Function* awaitFd() {
+      if (auto fn = module_.getFunction("eva.await_fd")) {
+        return fn;
+      }
+
+      auto i32Ty = builder_.getInt32Ty();
+      auto loopFdFn = loopFd();
+      auto flushFn = flush();
+      auto fn = createFunction("eva.await_fd", builder_.getVoidTy(),
+                               {getBytePtrTy(), i32Ty, builder_.getInt1Ty()});
+
+      // Waiter: {coroutine, fd, once}, the data of the event.
+      auto waiterTy = getWaiterType();
+      auto mallocFn = module_.getOrInsertFunction("malloc", getBytePtrTy(),
+                                                  builder_.getInt64Ty());
+      auto waiter = builder_.CreateBitCast(
+          builder_.CreateCall(mallocFn, {builder_.getInt64(16)}),
+          waiterTy->getPointerTo(), "waiter");
+      builder_.CreateStore(fn->getArg(0),
+                           builder_.CreateStructGEP(waiterTy, waiter, 0));
+      builder_.CreateStore(fn->getArg(1),
+                           builder_.CreateStructGEP(waiterTy, waiter, 1));
+      builder_.CreateStore(builder_.CreateZExt(fn->getArg(2), i32Ty),
+                           builder_.CreateStructGEP(waiterTy, waiter, 2));
+
+      // epoll_ctl(loop, EPOLL_CTL_ADD, fd, {EPOLLIN, waiter})
+      auto eventTy = getEpollEventType();
+      auto event = builder_.CreateAlloca(eventTy, nullptr, "event");
+      builder_.CreateStore(builder_.getInt32(EPOLLIN_),
+                           builder_.CreateStructGEP(eventTy, event, 0));
+      builder_.CreateStore(
+          builder_.CreatePtrToInt(waiter, builder_.getInt64Ty()),
+          builder_.CreateStructGEP(eventTy, event, 1));
+      auto added = builder_.CreateCall(
+          getEpollCtl(), {builder_.CreateCall(loopFdFn),
+                          builder_.getInt32(EPOLL_CTL_ADD_), fn->getArg(1),
+                          builder_.CreateBitCast(event, getBytePtrTy())});
+
+      auto failed = createBB("failed", fn);
+      auto waiting = createBB("waiting", fn);
+      builder_.CreateCondBr(
+          builder_.CreateICmpSLT(added, builder_.getInt32(0)), failed,
+          waiting);
+
+      // Not waited for, the loop would wait forever: reported, with the
+      // reason (errno), and the program exits.
+      builder_.SetInsertPoint(failed);
+      builder_.CreateCall(flushFn);
+      auto dprintfFn = module_.getOrInsertFunction(
+          "dprintf", llvm::FunctionType::get(i32Ty, {i32Ty, getBytePtrTy()},
+                                             /* vararg */ true));
+      builder_.CreateCall(
+          dprintfFn, {builder_.getInt32(2),
+                      getString("eva.str.await_failed",
+                                "Runtime error: can't await fd %d: "),
+                      fn->getArg(1)});
+      auto perrorFn = module_.getOrInsertFunction(
+          "perror", builder_.getVoidTy(), getBytePtrTy());
+      builder_.CreateCall(perrorFn, {getString("eva.str.empty", "")});
+      auto exitFn = module_.getOrInsertFunction("exit", builder_.getVoidTy(),
+                                                i32Ty);
+      builder_.CreateCall(exitFn, {builder_.getInt32(1)});
+      builder_.CreateUnreachable();
+
+      builder_.SetInsertPoint(waiting);
+      addWaiting(1);
+      builder_.CreateRetVoid();
+      return fn;
+    }
+
+    /**
+     * void eva.loop_run(): resumes the coroutines as their events come,
+     * till none is waiting. The output is flushed before waiting.
+     */
+    llvm::Function* loopRun() {
+      if (auto fn = module_.getFunction("eva.loop_run")) {
+        return fn;
+      }
+
+      auto i32Ty = builder_.getInt32Ty();
+      auto i64Ty = builder_.getInt64Ty();
+      auto loopFdFn = loopFd();
+      auto flushFn = flush();
+      auto fn = createFunction("eva.loop_run", builder_.getVoidTy(), {});
+      auto wait = createBB("wait", fn);
+      auto events = createBB("events", fn);
+      auto resume = createBB("resume", fn);
+      auto done = createBB("done", fn);
+
+      auto eventTy = getEpollEventType();
+      auto eventsTy = llvm::ArrayType::get(eventTy, MAX_EVENTS);
+      auto buffer = builder_.CreateAlloca(eventsTy, nullptr, "buffer");
+      builder_.CreateBr(wait);
+
+      // while (waiting > 0): count = epoll_wait(loop, buffer, MAX, -1)
+      builder_.SetInsertPoint(wait);
+      auto waiting = builder_.CreateLoad(i64Ty, getWaiting());
+      auto epollWait = module_.getOrInsertFunction(
+          "epoll_wait", i32Ty, i32Ty, getBytePtrTy(), i32Ty, i32Ty);
+      auto waitBlock = createBB("poll", fn);
+      builder_.CreateCondBr(
+          builder_.CreateICmpSGT(waiting, builder_.getInt64(0)), waitBlock,
+          done);
+
+      // All the output so far is written before blocking (also the one
+      // of plain printf calls, in the C library buffers):
+      builder_.SetInsertPoint(waitBlock);
+      builder_.CreateCall(flushFn);
+      builder_.CreateCall(getFflush(),
+                          {llvm::ConstantPointerNull::get(getBytePtrTy())});
+      auto count = builder_.CreateCall(
+          epollWait, {builder_.CreateCall(loopFdFn),
+                      builder_.CreateBitCast(buffer, getBytePtrTy()),
+                      builder_.getInt32(MAX_EVENTS), builder_.getInt32(-1)},
+          "count");
+      builder_.CreateBr(events);
+
+      // for (i = 0; i < count; i++): resume the waiter of the event.
+      builder_.SetInsertPoint(events);
+      auto index = builder_.CreatePHI(i32Ty, 2, "i");
+      builder_.CreateCondBr(builder_.CreateICmpSLT(index, count), resume,
+                            wait);
+
+      builder_.SetInsertPoint(resume);
+      auto dataPtr = builder_.CreateInBoundsGEP(
+          eventsTy, buffer,
+          {builder_.getInt64(0), index, builder_.getInt32(1)});
+      auto waiterTy = getWaiterType();
+      auto waiter = builder_.CreateIntToPtr(
+          builder_.CreateLoad(i64Ty, dataPtr), waiterTy->getPointerTo(),
+          "waiter");
+      auto coroutine = builder_.CreateLoad(
+          getBytePtrTy(), builder_.CreateStructGEP(waiterTy, waiter, 0));
+      auto fd = builder_.CreateLoad(
+          i32Ty, builder_.CreateStructGEP(waiterTy, waiter, 1));
+      auto once = builder_.CreateLoad(
+          i32Ty, builder_.CreateStructGEP(waiterTy, waiter, 2));
+
+      builder_.CreateCall(getEpollCtl(),
+                          {builder_.CreateCall(loopFdFn),
+                           builder_.getInt32(EPOLL_CTL_DEL_), fd,
+                           llvm::ConstantPointerNull::get(getBytePtrTy())});
+
+      auto closeBlock = createBB("close", fn);
+      auto resumeBlock = createBB("resume.coroutine", fn);
+      builder_.CreateCondBr(builder_.CreateICmpNE(once, builder_.getInt32(0)),
+                            closeBlock, resumeBlock);
+
+      builder_.SetInsertPoint(closeBlock);
+      auto closeFn = module_.getOrInsertFunction("close", i32Ty, i32Ty);
+      builder_.CreateCall(closeFn, {fd});
+      builder_.CreateBr(resumeBlock);
+
+      builder_.SetInsertPoint(resumeBlock);
+      auto freeFn = module_.getOrInsertFunction("free", builder_.getVoidTy(),
+                                                getBytePtrTy());
+      builder_.CreateCall(freeFn,
+                          {builder_.CreateBitCast(waiter, getBytePtrTy())});
+      addWaiting(-1);
+      auto coroResume = llvm::Intrinsic::getDeclaration(
+          &module_, llvm::Intrinsic::coro_resume);
+      builder_.CreateCall(coroResume, {coroutine});
+      auto next = builder_.CreateAdd(index, builder_.getInt32(1));
+      builder_.CreateBr(events);
+
+      index->addIncoming(builder_.getInt32(0), waitBlock);
+      index->addIncoming(next, resumeBlock);
+
+      builder_.SetInsertPoint(done);
+      builder_.CreateRetVoid();
+      return fn;
+    }
+
+    /**
+     * int printf(const char* format, ...)
+     */
+    static llvm::FunctionType* getPrintfType(llvm::LLVMContext& ctx) {
+      return llvm::FunctionType::get(
+          /* return type */ llvm::Type::getInt32Ty(ctx),
+          /* format arg */ llvm::Type::getInt8PtrTy(ctx),
+          /* vararg */ true);
+    }
+
+  private:
+    /**
+     * Output buffer size, and the digits of the largest u64.
+     */
+    static constexpr uint64_t CAPACITY = 64 * 1024;
+    static constexpr uint64_t MAX_DIGITS = 20;
+
+    /**
+     * Arena chunk size, chunk header size, and object alignment.
+     */
+    static constexpr uint64_t ARENA_CHUNK = 1024 * 1024;
+    static constexpr uint64_t ARENA_HEADER = 16;
+    static constexpr uint64_t ARENA_ALIGN = 16;
+
+    /**
+     * Events taken by one epoll_wait, and the Linux constants of the
+     * event loop.
+     */
+    static constexpr int MAX_EVENTS = 16;
+    static constexpr int EPOLLIN_ = 1;
+    static constexpr int EPOLL_CTL_ADD_ = 1;
+    static constexpr int EPOLL_CTL_DEL_ = 2;
+    static constexpr int CLOCK_MONOTONIC_ = 1;
+
+    /**
+     * Creates a runtime function, and starts its entry block.
+     */
+    llvm::Function* createFunction(const char* name, llvm::Type* returnType,
+                                   llvm::ArrayRef<llvm::Type*> paramTypes) {
+      auto fn = llvm::Function::Create(
+          llvm::FunctionType::get(returnType, paramTypes, /* vararg */ false),
+          linkage_, name, module_);
+      fn->addFnAttr(llvm::Attribute::NoUnwind);
+      builder_.SetInsertPoint(createBB("entry", fn));
+      return fn;
+    }
+
+    llvm::BasicBlock* createBB(const char* name, llvm::Function* fn) {
+      return llvm::BasicBlock::Create(module_.getContext(), name, fn);
+    }
+
+    /**
+     * Pointer into the output buffer: &buffer[offset].
+     */
+    llvm::Value* getBuffer(llvm::Value* offset) {
+      auto bufferTy = llvm::ArrayType::get(builder_.getInt8Ty(), CAPACITY);
+      auto buffer = getGlobal("eva.out", bufferTy);
+      return builder_.CreateInBoundsGEP(bufferTy, buffer,
+                                        {builder_.getInt64(0), offset});
+    }
+
+    /**
+     * Number of bytes in the output buffer.
+     */
+    llvm::GlobalVariable* getLength() {
+      return getGlobal("eva.out.length", builder_.getInt64Ty());
+    }
+
+    /**
+     * Arena: current chunk, and the top and end of its free space.
+     */
+    llvm::GlobalVariable* getArenaChunk() {
+      return getGlobal("eva.arena.chunk", getBytePtrTy());
+    }
+
+    llvm::GlobalVariable* getArenaTop() {
+      return getGlobal("eva.arena.top", getBytePtrTy());
+    }
+
+    llvm::GlobalVariable* getArenaEnd() {
+      return getGlobal("eva.arena.end", getBytePtrTy());
+    }
+
+    /**
+     * i32 eva.loop_fd(): the epoll instance, created on first use.
+     */
+    llvm::Function* loopFd() {
+      if (auto fn = module_.getFunction("eva.loop_fd")) {
+        return fn;
+      }
+
+      auto i32Ty = builder_.getInt32Ty();
+      auto fn = createFunction("eva.loop_fd", i32Ty, {});
+      auto create = createBB("create", fn);
+      auto done = createBB("done", fn);
+
+      auto loop = getGlobal("eva.loop.fd", i32Ty, builder_.getInt32(-1));
+      auto current = builder_.CreateLoad(i32Ty, loop);
+      builder_.CreateCondBr(
+          builder_.CreateICmpSGE(current, builder_.getInt32(0)), done, create);
+
+      builder_.SetInsertPoint(create);
+      auto epollCreate =
+          module_.getOrInsertFunction("epoll_create1", i32Ty, i32Ty);
+      auto created = builder_.CreateCall(epollCreate, {builder_.getInt32(0)});
+      builder_.CreateStore(created, loop);
+      builder_.CreateBr(done);
+
+      builder_.SetInsertPoint(done);
+      auto result = builder_.CreatePHI(i32Ty, 2);
+      result->addIncoming(current, &fn->getEntryBlock());
+      result->addIncoming(created, create);
+      builder_.CreateRet(result);
+      return fn;
+    }
+
+    /**
+     * Waiter of an event: {coroutine, fd, once}.
+     */
+    llvm::StructType* getWaiterType() {
+      auto i32Ty = builder_.getInt32Ty();
+      return llvm::StructType::get(module_.getContext(),
+                                   {getBytePtrTy(), i32Ty, i32Ty});
+    }
+
+    /**
+     * struct epoll_event {u32 events; u64 data}, packed on x86-64.
+     */
+    llvm::StructType* getEpollEventType() {
+      auto triple = llvm::Triple(llvm::sys::getDefaultTargetTriple());
+      auto packed = triple.getArch() == llvm::Triple::x86_64;
+      return llvm::StructType::get(
+          module_.getContext(), {builder_.getInt32Ty(), builder_.getInt64Ty()},
+          packed);
+    }
+
+    /**
+     * int fflush(FILE* stream), all the streams if null.
+     */
+    llvm::FunctionCallee getFflush() {
+      return module_.getOrInsertFunction("fflush", builder_.getInt32Ty(),
+                                         getBytePtrTy());
+    }
+
+    /**
+     * int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event)
+     */
+    llvm::FunctionCallee getEpollCtl() {
+      auto i32Ty = builder_.getInt32Ty();
+      return module_.getOrInsertFunction("epoll_ctl", i32Ty, i32Ty, i32Ty,
+                                         i32Ty, getBytePtrTy());
+    }
+
+    /**
+     * Number of coroutines waiting for an event.
+     */
+    llvm::GlobalVariable* getWaiting() {
+      return getGlobal("eva.loop.waiting", builder_.getInt64Ty());
+    }
+
+    void addWaiting(int64_t delta) {
+      auto waiting = builder_.CreateLoad(builder_.getInt64Ty(), getWaiting());
+      builder_.CreateStore(
+          builder_.CreateAdd(waiting, builder_.getInt64(delta)), getWaiting());
+    }
+
+    /**
+     * Global of the runtime, zero-initialized by default.
+     */
+    llvm::GlobalVariable* getGlobal(const char* name, llvm::Type* type,
+                                    llvm::Constant* init = nullptr) {
+      if (auto global = module_.getNamedGlobal(name)) {
+        return global;
+      }
+      return new llvm::GlobalVariable(
+          module_, type, /* constant */ false, linkage_,
+          init ? init : llvm::Constant::getNullValue(type), name);
+    }
+
+    /**
+     * String constant of the runtime: one global of the module per name,
+     * shared by the runtime functions.
+     */
+    llvm::Constant* getString(const char* name, llvm::StringRef str) {
+      auto global = module_.getNamedGlobal(name);
+      if (global == nullptr) {
+        global = builder_.CreateGlobalString(str, name, /* address space */ 0,
+                                             &module_);
+      }
+
+      llvm::Constant* zero = builder_.getInt32(0);
+      return llvm::ConstantExpr::getInBoundsGetElementPtr(
+          global->getValueType(), global, llvm::ArrayRef({zero, zero}));
+    }
+
+    llvm::PointerType* getBytePtrTy() {
+      return builder_.getInt8Ty()->getPointerTo();
+    }
+
+    llvm::Module& module_;
+    llvm::GlobalValue::LinkageTypes linkage_;
+
+    /**
+     * Builder of the runtime functions (the compiler one is left as is).
+     */
+    llvm::IRBuilder<> builder_;
+};
+
+#endif//EvaRuntime_h
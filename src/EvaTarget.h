@@ -0,0 +1,214 @@
+/**
+ * Native code generation: object files and executables.
+ */
+#ifndef EvaTarget_h
+#define EvaTarget_h
+
+#include <stdlib.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include "Logger.h"
+
+/**
+ * Host target machine.
+ *
+ * CPU "native" selects the host CPU together with all the features it
+ * supports (as -march=native does); extra `features` are appended in
+ * the LLVM format: "+avx2,-fma".
+ */
+class EvaTarget {
+  public:
+    EvaTarget(const std::string& cpu, const std::string& features,
+              unsigned optLevel) {
+      llvm::InitializeNativeTarget();
+      llvm::InitializeNativeTargetAsmPrinter();
+
+      triple_ = llvm::sys::getDefaultTargetTriple();
+
+      std::string error;
+      target_ = llvm::TargetRegistry::lookupTarget(triple_, error);
+      if (target_ == nullptr) {
+        DIE << "Target \"" << triple_ << "\": " << error << "\n";
+      }
+
+      cpu_ = cpu.empty() ? std::string("generic") : cpu;
+      features_ = features;
+
+      if (cpu == "native") {
+        cpu_ = llvm::sys::getHostCPUName().str();
+        features_ = getHostFeatures() +
+                    (features.empty() ? "" : "," + features);
+      }
+
+      optLevel_ = getCodeGenOptLevel(optLevel);
+      targetMachine_ = createTargetMachine();
+    }
+
+    /**
+     * Target machine (e.g. for the cost model of the optimizer).
+     */
+    llvm::TargetMachine* getTargetMachine() { return targetMachine_.get(); }
+
+    /**
+     * Sets the module target triple and data layout, should be done
+     * before optimizing the module.
+     */
+    void configure(llvm::Module& module) {
+      module.setTargetTriple(targetMachine_->getTargetTriple().str());
+      module.setDataLayout(targetMachine_->createDataLayout());
+    }
+
+    /**
+     * Compiles the module to a native object file.
+     */
+    void emitObject(llvm::Module& module, const std::string& fileName) {
+      std::error_code errorCode;
+      llvm::raw_fd_ostream out(fileName, errorCode, llvm::sys::fs::OF_None);
+      if (errorCode) {
+        DIE << "Cannot open \"" << fileName << "\": " << errorCode.message()
+            << "\n";
+      }
+
+      llvm::legacy::PassManager codegen;
+      if (targetMachine_->addPassesToEmitFile(codegen, out, nullptr,
+                                              llvm::CGFT_ObjectFile)) {
+        DIE << "Target cannot emit object files.\n";
+      }
+
+      codegen.run(module);
+      out.flush();
+    }
+
+    /**
+     * Compiles the module to native object files in parallel: the module
+     * is split into one partition of functions per file, and each one is
+     * compiled on its own thread, with its own target machine.
+     *
+     * The module is modified (local symbols of different partitions are
+     * externalized), so this should be the last use of it.
+     */
+    void emitObjects(llvm::Module& module,
+                     const std::vector<std::string>& fileNames) {
+      std::vector<std::unique_ptr<llvm::raw_fd_ostream>> files;
+      std::vector<llvm::raw_pwrite_stream*> outs;
+
+      for (auto& fileName : fileNames) {
+        std::error_code errorCode;
+        files.push_back(std::make_unique<llvm::raw_fd_ostream>(
+            fileName, errorCode, llvm::sys::fs::OF_None));
+        if (errorCode) {
+          DIE << "Cannot open \"" << fileName << "\": "
+              << errorCode.message() << "\n";
+        }
+        outs.push_back(files.back().get());
+      }
+
+      llvm::splitCodeGen(module, outs, /* bitcode outs */ {},
+                         [this]() { return createTargetMachine(); });
+    }
+
+    /**
+     * Links object files into an executable with the system C compiler
+     * driver (`cc`, or the one set in the CC environment variable).
+     */
+    static void link(const std::vector<std::string>& objectFiles,
+                     const std::string& executable) {
+      auto cc = getenv("CC");
+      auto driver = std::string(cc != nullptr ? cc : "cc");
+
+      auto program = llvm::sys::findProgramByName(driver);
+      if (!program) {
+        DIE << "Link failed: can't find the C compiler \"" << driver
+            << "\": " << program.getError().message() << "\n";
+      }
+
+      std::vector<llvm::StringRef> args{driver};
+      for (auto& objectFile : objectFiles) {
+        args.push_back(objectFile);
+      }
+      args.push_back("-o");
+      args.push_back(executable);
+
+      std::string errorMessage;
+      auto status = llvm::sys::ExecuteAndWait(*program, args, llvm::None, {},
+                                              0, 0, &errorMessage);
+      if (status != 0) {
+        DIE << "Link failed: " << driver << " "
+            << (status < 0 ? errorMessage
+                           : "exited with status " + std::to_string(status))
+            << "\n";
+      }
+    }
+
+  private:
+    /**
+     * Creates a target machine for the selected triple, CPU and features.
+     */
+    std::unique_ptr<llvm::TargetMachine> createTargetMachine() {
+      return std::unique_ptr<llvm::TargetMachine>(target_->createTargetMachine(
+          triple_, cpu_, features_, llvm::TargetOptions(), llvm::Reloc::PIC_,
+          llvm::None, optLevel_));
+    }
+
+    /**
+     * Host CPU features in the LLVM format: "+sse4.2,+avx,-avx512f,..."
+     */
+    static std::string getHostFeatures() {
+      llvm::StringMap<bool> hostFeatures;
+      std::string result;
+
+      if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+        for (auto& feature : hostFeatures) {
+          if (!result.empty()) {
+            result += ",";
+          }
+          result += (feature.second ? "+" : "-") + feature.first().str();
+        }
+      }
+      return result;
+    }
+
+    static llvm::CodeGenOpt::Level getCodeGenOptLevel(unsigned optLevel) {
+      switch (optLevel) {
+        case 0:
+          return llvm::CodeGenOpt::None;
+        case 1:
+          return llvm::CodeGenOpt::Less;
+        case 2:
+          return llvm::CodeGenOpt::Default;
+        default:
+          return llvm::CodeGenOpt::Aggressive;
+      }
+    }
+
+    /**
+     * Target, and the selected triple, CPU, features and codegen level.
+     */
+    const llvm::Target* target_;
+    std::string triple_;
+    std::string cpu_;
+    std::string features_;
+    llvm::CodeGenOpt::Level optLevel_;
+
+    /**
+     * Target machine for the host triple.
+     */
+    std::unique_ptr<llvm::TargetMachine> targetMachine_;
+};
+
+#endif//EvaTarget_h
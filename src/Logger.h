@@ -7,13 +7,40 @@
 
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 
-class ErrorLogMessage : public std::basic_ostringstream<char> {
+/**
+ * Error thrown by DIE when errors are recoverable.
+ */
+class EvaError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+class ErrorLogMessage {
   public:
-    ~ErrorLogMessage() {
-      std::cerr << "Fatal error: " << str().c_str();
+    /**
+     * Whether DIE throws an EvaError instead of exiting (e.g. in an
+     * interactive session, which goes on after an error).
+     */
+    static inline bool recoverable = false;
+
+    template <typename T>
+    ErrorLogMessage& operator<<(const T& value) {
+      message_ << value;
+      return *this;
+    }
+
+    ~ErrorLogMessage() noexcept(false) {
+      if (recoverable) {
+        throw EvaError(message_.str());
+      }
+      std::cerr << "Fatal error: " << message_.str().c_str();
       exit(EXIT_FAILURE);
     }
+
+  private:
+    std::ostringstream message_;
 };
 
 #define DIE ErrorLogMessage()
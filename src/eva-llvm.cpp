@@ -1,7 +1,12 @@
 /**
  * Eva LLVM executable
  */
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
 #include <string>
+#include <string_view>
 
 #include "EvaLLVM.h"
 
@@ -13,21 +18,142 @@ int main(int argc, char const *argv[]) {
     (var z 32)
     (var x (+ z 10))
 
-    // (if (== x 42)
-    //   (set x 100)
-    //   (set x 200)
-    // )
+    (if (== x 42)
+      (set x 100)
+      (set x 200)
+    )
     (printf "Is X == 42? : %d\n" (> x 42))
   )";
 
+  /**
+   * Usage: eva-llvm [options] [<file> | -]
+   *
+   * The source file (mapped to memory) or stdin (with "-") is compiled
+   * one top-level form at a time. Without it, the program above is
+   * compiled.
+   *
+   * Options:
+   *
+   *   --jit           run in-process instead of emitting out.ll
+   *   --repl          interactive session: each form typed on stdin is
+   *                   run as it is complete, and the values of
+   *                   expressions are printed
+   *   -O0 ... -O3     optimization level
+   *   --time-passes   report the time of each optimization pass
+   *   --emit-obj      compile to a native object file (out.o)
+   *   --emit-exe      compile and link a native executable (out)
+   *   --emit-bc       save the module bitcode (out.bc)
+   *   -march=<cpu>    target CPU, e.g. -march=native
+   *   -mattr=<attrs>  target features, e.g. -mattr=+avx2,-fma
+   *   -o <file>       output file
+   *   -j <n>          compile functions to native code on <n> threads
+   *                   (--emit-exe, --jit); parsing, IR generation and
+   *                   optimization are single-threaded
+   *   --time-report[=json]
+   *                   report the time of each compiler phase and the
+   *                   work counters to stderr (as a table, or JSON)
+   *   --cache[=<dir>] reuse compiled modules of unchanged programs,
+   *                   cached in <dir> (.eva-cache by default)
+   */
+  EvaOptions options;
+  std::string_view sourceFile;
+  auto repl = false;
+
+  for (auto i = 1; i < argc; i++) {
+    auto arg = std::string_view(argv[i]);
+
+    if (arg == "--jit") {
+      options.mode = ExecMode::JIT;
+    }
+
+    else if (arg == "--repl") {
+      repl = true;
+    }
+
+    else if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' &&
+             arg[2] >= '0' && arg[2] <= '3') {
+      options.optLevel = arg[2] - '0';
+    }
+
+    else if (arg == "--time-passes") {
+      options.timePasses = true;
+    }
+
+    else if (arg == "--emit-obj") {
+      options.mode = ExecMode::Object;
+    }
+
+    else if (arg == "--emit-exe") {
+      options.mode = ExecMode::Executable;
+    }
+
+    else if (arg.substr(0, 7) == "-march=") {
+      options.cpu = arg.substr(7);
+    }
+
+    else if (arg.substr(0, 7) == "-mattr=") {
+      options.features = arg.substr(7);
+    }
+
+    else if (arg == "--emit-bc") {
+      options.mode = ExecMode::Bitcode;
+    }
+
+    else if (arg == "--cache") {
+      options.cacheDir = ".eva-cache";
+    }
+
+    else if (arg.substr(0, 8) == "--cache=") {
+      options.cacheDir = arg.substr(8);
+    }
+
+    else if (arg == "-o" && i + 1 < argc) {
+      options.output = argv[++i];
+    }
+
+    else if (arg == "--time-report") {
+      options.timeReport = TimeReport::Table;
+    }
+
+    else if (arg == "--time-report=json") {
+      options.timeReport = TimeReport::JSON;
+    }
+
+    else if (arg == "-j" && i + 1 < argc) {
+      options.jobs = std::max(1, atoi(argv[++i]));
+    }
+
+    else if (arg == "-" || arg[0] != '-') {
+      sourceFile = arg;
+    }
+  }
+
+  // Code generation runs in parallel only for a native executable (one
+  // object per job) and in the JIT:
+  if (options.jobs > 1 && (repl || (options.mode != ExecMode::Executable &&
+                                    options.mode != ExecMode::JIT))) {
+    DIE << "-j is supported with --emit-exe and --jit only.\n";
+  }
+
   /**
    * Compiler instance.
    */
-  EvaLLVM vm;
+  EvaLLVM vm(options);
+
+  if (repl) {
+    return vm.repl(std::cin, isatty(STDIN_FILENO));
+  }
 
   /** 
-   * Generate LLVM IR
+   * Generate LLVM IR (or run it)
    */
-  vm.exec(program);
-  return 0;
+  if (sourceFile == "-") {
+    return vm.exec(std::cin);
+  }
+
+  if (!sourceFile.empty()) {
+    return vm.execFile(std::string(sourceFile));
+  }
+
+  return vm.exec(program);
 }
@@ -0,0 +1,285 @@
+/**
+ * Arena-allocated AST.
+ */
+
+#ifndef Ast_h
+#define Ast_h
+
+#include <stdint.h>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Interner.h"
+
+/**
+ * Expression type.
+ */
+enum class ExpType {
+  NUMBER,
+  FLOAT,
+  STRING,
+  SYMBOL,
+  LIST,
+};
+
+struct Exp;
+
+/**
+ * List entries: a contiguous range of nodes in the AST arena.
+ *
+ * The range is kept as indices (not pointers), so it stays valid
+ * while the arena grows.
+ */
+class ExpList {
+  public:
+    const Exp& operator[](size_t i) const;
+
+    size_t size() const { return size_; }
+
+    const Exp* begin() const;
+    const Exp* end() const;
+
+  private:
+    friend class AstArena;
+
+    const std::vector<Exp>* pool_ = nullptr;
+    uint32_t first_ = 0;
+    uint32_t size_ = 0;
+};
+
+/**
+ * Expression.
+ *
+ * A small trivially copyable node: strings and symbols are interned
+ * handles, lists refer to their entries in the arena.
+ */
+struct Exp {
+  ExpType type = ExpType::LIST;
+
+  // Lists: offset of the "(" in the parsed string, for error locations.
+  uint32_t offset = 0;
+
+  // Numbers: integer (NUMBER) or floating point (FLOAT).
+  union {
+    int64_t number = 0;
+    double real;
+  };
+
+  // Strings, Symbols: interned handle and its text.
+  Symbol symbol = 0;
+  std::string_view string;
+
+  // Lists:
+  ExpList list;
+};
+
+inline const Exp& ExpList::operator[](size_t i) const {
+  return (*pool_)[first_ + i];
+}
+
+inline const Exp* ExpList::begin() const {
+  return pool_ == nullptr ? nullptr : pool_->data() + first_;
+}
+
+inline const Exp* ExpList::end() const { return begin() + size_; }
+
+/**
+ * AST arena: owns all the list nodes of the parsed program in one pool.
+ *
+ * Lists are built bottom-up by the parser: entries of the lists being
+ * parsed are collected on the pending stack, and once a list is closed
+ * its entries are moved to the pool as one contiguous range. Both
+ * vectors keep their capacity on `reset`, so re-parsing does not
+ * allocate per node.
+ */
+class AstArena {
+  public:
+    /**
+     * Drops all the nodes. Interned strings are kept.
+     */
+    void reset() {
+      nodes_.clear();
+      pending_.clear();
+    }
+
+    /**
+     * Number: 42, 3.14
+     */
+    Exp number(std::string_view text) {
+      Exp exp;
+      std::from_chars_result result;
+
+      if (text.find('.') != std::string_view::npos) {
+        exp.type = ExpType::FLOAT;
+        result = std::from_chars(text.data(), text.data() + text.size(),
+                                 exp.real);
+      } else {
+        exp.type = ExpType::NUMBER;
+        result = std::from_chars(text.data(), text.data() + text.size(),
+                                 exp.number);
+      }
+
+      if (result.ec == std::errc::result_out_of_range) {
+        throw std::runtime_error("Number \"" + std::string(text) +
+                                 "\" is out of range.");
+      }
+      return exp;
+    }
+
+    /**
+     * String: "Hello\n" (with the quotes). Escapes are decoded here, once:
+     * \n \t \r \0 \" \\ and \xNN (a hex byte).
+     */
+    Exp string(std::string_view quoted) {
+      auto text = quoted.substr(1, quoted.size() - 2);
+      if (text.find('\\') == std::string_view::npos) {
+        return interned(ExpType::STRING, text);
+      }
+
+      std::string decoded;
+      decoded.reserve(text.size());
+
+      for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\\') {
+          decoded += text[i];
+          continue;
+        }
+
+        switch (auto c = text[++i]) {
+          case 'n':
+            decoded += '\n';
+            break;
+          case 't':
+            decoded += '\t';
+            break;
+          case 'r':
+            decoded += '\r';
+            break;
+          case '0':
+            decoded += '\0';
+            break;
+          case '"':
+          case '\\':
+            decoded += c;
+            break;
+          case 'x': {
+            unsigned byte = 0;
+            auto digits = text.substr(i + 1, 2);
+            auto result = std::from_chars(digits.data(),
+                                          digits.data() + digits.size(),
+                                          byte, 16);
+            if (digits.size() != 2 || result.ptr != digits.data() + 2) {
+              throw std::runtime_error("Invalid escape \"\\x" +
+                                       std::string(digits) + "\" in string.");
+            }
+            decoded += (char)byte;
+            i += 2;
+            break;
+          }
+          default:
+            throw std::runtime_error("Invalid escape \"\\" +
+                                     std::string(1, c) + "\" in string.");
+        }
+      }
+
+      // Decoded strings are copies:
+      return interned(ExpType::STRING, decoded, /* borrow */ false);
+    }
+
+    /**
+     * Symbol: foo
+     */
+    Exp symbol(std::string_view name) {
+      return interned(ExpType::SYMBOL, name);
+    }
+
+    /**
+     * Opens a list, its entries are collected on the pending stack.
+     */
+    Exp beginList(uint32_t offset) {
+      Exp exp;
+      exp.offset = offset;
+      exp.list.first_ = pending_.size();
+      return exp;
+    }
+
+    /**
+     * Appends an entry to the open list.
+     */
+    void append(Exp& list, const Exp& entry) {
+      pending_.push_back(entry);
+      list.list.size_++;
+    }
+
+    /**
+     * Closes the list, moving its entries to the pool.
+     */
+    Exp endList(const Exp& list) {
+      auto first = pending_.begin() + list.list.first_;
+
+      Exp exp;
+      exp.offset = list.offset;
+      exp.list.pool_ = &nodes_;
+      exp.list.first_ = nodes_.size();
+      exp.list.size_ = list.list.size_;
+
+      nodes_.insert(nodes_.end(), first, pending_.end());
+      pending_.erase(first, pending_.end());
+
+      return exp;
+    }
+
+    /**
+     * Whether strings and symbols refer to the parsed text instead of
+     * copies. The text should then outlive the interner.
+     */
+    void borrowStrings(bool borrow) { borrow_ = borrow; }
+
+    /**
+     * Number of nodes in the pool.
+     */
+    size_t size() const { return nodes_.size(); }
+
+    /**
+     * Strings and symbols interner.
+     */
+    Interner& interner() { return interner_; }
+
+  private:
+    Exp interned(ExpType type, std::string_view str) {
+      return interned(type, str, borrow_);
+    }
+
+    Exp interned(ExpType type, std::string_view str, bool borrow) {
+      Exp exp;
+      exp.type = type;
+      exp.symbol = interner_.intern(str, borrow);
+      exp.string = interner_.name(exp.symbol);
+      return exp;
+    }
+
+    /**
+     * Entries of the closed lists.
+     */
+    std::vector<Exp> nodes_;
+
+    /**
+     * Entries of the lists being parsed.
+     */
+    std::vector<Exp> pending_;
+
+    /**
+     * Interned strings and symbols.
+     */
+    Interner interner_;
+
+    /**
+     * Whether to intern without copying.
+     */
+    bool borrow_ = false;
+};
+
+#endif//Ast_h
@@ -21,13 +21,15 @@
 #pragma clang diagnostic ignored "-Wunused-private-field"
 
 #include <assert.h>
+#include <stdint.h>
 #include <array>
+#include <chrono>
 #include <iostream>
-#include <map>
-#include <memory>
-#include <regex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 // ------------------------------------
@@ -50,46 +52,7 @@
 //   }
 //
 // clang-format off
-#include <string>
-#include <vector>
-
-/**
- * Expression type.
- */
-enum class ExpType {
-  NUMBER,
-  STRING,
-  SYMBOL,
-  LIST,
-};
-
-/** 
- * Expression.
- */
-struct Exp {
-  ExpType type;
-
-  int number;
-  std::string string;
-  std::vector<Exp> list;
-
-  // Numbers:
-  Exp(int number) : type(ExpType::NUMBER), number(number) {}
-
-  // Strings, Symbols:
-  Exp(std::string& strVal) {
-    if (strVal[0] == '"') {
-      type = ExpType::STRING;
-      string = strVal.substr(1, strVal.size() - 2);
-    } else {
-      type = ExpType::SYMBOL;
-      string = strVal;
-    }
-   }
-
-   // Lists:
-   Exp(std::vector<Exp> list) : type(ExpType::LIST), list(list) {}
-};
+#include "Ast.h"
 
 using Value = Exp;  // clang-format on
 
@@ -128,28 +91,79 @@ enum class TokenType {
 // ------------------------------------------------------------------
 // Token.
 
+//
+// A small trivially copyable value: the text is a slice of the
+// tokenizing string, see `Tokenizer::text`.
+
 struct Token {
   TokenType type;
-  std::string value;
-
-  int startOffset;
-  int endOffset;
-  int startLine;
-  int endLine;
-  int startColumn;
-  int endColumn;
+
+  // Slice of the tokenizing string (so a string parsed is at most
+  // `MAX_INPUT_SIZE` bytes).
+  uint32_t offset;
+  uint32_t length;
+
+  // Start location.
+  int line;
+  int column;
 };
 
-using SharedToken = std::shared_ptr<Token>;
+static_assert(std::is_trivially_copyable<Token>::value,
+              "Tokens are copied by value.");
 
-typedef TokenType (*LexRuleHandler)(const Tokenizer&, const std::string&);
+static constexpr size_t MAX_INPUT_SIZE = UINT32_MAX;
+
+//
+// Invalid value of a token (e.g. a bad string escape, or a number out
+// of range), at its location in the parsed string.
+//
+class ValueError : public std::runtime_error {
+ public:
+  ValueError(const std::string& message, int line, int column)
+      : std::runtime_error(message), line(line), column(column) {}
+
+  int line;
+  int column;
+};
 
 // ------------------------------------------------------------------
-// Lex rule: [regex, handler]
+// Character classes of the lexical grammar:
+//
+//   \s               -> CC_SPACE
+//   \d               -> CC_DIGIT
+//   [\w\-+*=!<>/]    -> CC_SYMBOL
+
+enum CharClass : uint8_t {
+  CC_SPACE = 1 << 0,
+  CC_DIGIT = 1 << 1,
+  CC_SYMBOL = 1 << 2,
+};
 
-struct LexRule {
-  std::regex regex;
-  LexRuleHandler handler;
+/**
+ * Byte -> character class flags, built at compile time.
+ */
+struct CharClassTable {
+  uint8_t flags[256];
+
+  constexpr CharClassTable() : flags{} {
+    for (auto c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+      flags[(uint8_t)c] |= CC_SPACE;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+      flags[c] |= CC_DIGIT | CC_SYMBOL;
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+      flags[c] |= CC_SYMBOL;
+      flags[c - 'a' + 'A'] |= CC_SYMBOL;
+    }
+    for (auto c : {'_', '-', '+', '*', '=', '!', '<', '>', '/'}) {
+      flags[(uint8_t)c] |= CC_SYMBOL;
+    }
+  }
+
+  constexpr bool is(char c, CharClass cc) const {
+    return (flags[(uint8_t)c] & cc) != 0;
+  }
 };
 
 // ------------------------------------------------------------------
@@ -163,14 +177,21 @@ enum TokenizerState {
 
 // ------------------------------------------------------------------
 // Tokenizer.
+//
+// Hand-written single-pass scanner for the lexical grammar from
+// EvaGrammar.bnf (replaces the regex rules generated by syntax-cli).
+// Rules are tried in the grammar order, first match wins, so the
+// token types and locations are the same as with the generated rules.
+// Keep `matchToken_` in sync when changing the `%lex` section.
 
 class Tokenizer {
  public:
   /**
-   * Initializes a parsing string.
+   * Initializes a parsing string. The string is not copied: it should
+   * outlive the tokens (and the parsed values referring to it).
    */
-  void initString(const std::string& str) {
-    str_ = str;
+  void initString(std::string_view str) {
+    input_ = str;
 
     // Initialize states.
     states_.clear();
@@ -187,12 +208,14 @@ class Tokenizer {
     tokenEndLine_ = 0;
     tokenStartColumn_ = 0;
     tokenEndColumn_ = 0;
+
+    unclosedComment_ = false;
   }
 
   /**
    * Whether there are still tokens in the stream.
    */
-  inline bool hasMoreTokens() { return cursor_ <= str_.length(); }
+  inline bool hasMoreTokens() { return cursor_ <= input_.length(); }
 
   /**
    * Returns current tokenizing state.
@@ -219,70 +242,81 @@ class Tokenizer {
   }
 
   /**
-   * Returns next token.
+   * Tokenizes the rest of the string into `tokens` (cleared first, so a
+   * reused buffer doesn't allocate), the last token is `__EOF`.
    */
-  SharedToken getNextToken() {
-    if (!hasMoreTokens()) {
-      yytext = __EOF;
-      return toToken(TokenType::__EOF);
-    }
+  void tokenize(std::vector<Token>& tokens) {
+    tokens.clear();
 
-    auto strSlice = str_.substr(cursor_);
-
-    auto lexRulesForState = lexRulesByStartConditions_.at(getCurrentState());
+    for (;;) {
+      tokens.push_back(getNextToken());
+      if (tokens.back().type == TokenType::__EOF) {
+        return;
+      }
+    }
+  }
 
-    for (const auto& ruleIndex : lexRulesForState) {
-      auto rule = lexRules_[ruleIndex];
-      std::smatch sm;
+  /**
+   * Returns next token.
+   */
+  Token getNextToken() {
+    for (;;) {
+      if (!hasMoreTokens()) {
+        yytext = __EOF;
+        return toToken(TokenType::__EOF);
+      }
 
-      if (std::regex_search(strSlice, sm, rule.regex)) {
-        yytext = sm[0];
+      if (isEOF()) {
+        cursor_++;
+        yytext = __EOF;
+        return toToken(TokenType::__EOF);
+      }
 
-        captureLocations_(yytext);
-        cursor_ += yytext.length();
+      auto tokenType = TokenType::__EMPTY;
+      auto length = matchToken_(tokenType);
 
-        // Manual handling of EOF token (the end of string). Return it
-        // as `EOF` symbol.
-        if (yytext.length() == 0) {
-          cursor_++;
-        }
+      if (length == 0) {
+        throwUnexpectedToken(input_.substr(cursor_, 1), currentLine_,
+                             currentColumn_);
+      }
 
-        auto tokenType = rule.handler(*this, yytext);
+      auto matched = input_.substr(cursor_, length);
 
-        if (tokenType == TokenType::__EMPTY) {
-          return getNextToken();
-        }
+      captureLocations_(matched);
+      cursor_ += length;
 
-        return toToken(tokenType);
+      // Skip whitespace and comments.
+      if (tokenType == TokenType::__EMPTY) {
+        continue;
       }
-    }
 
-    if (isEOF()) {
-      cursor_++;
-      yytext = __EOF;
-      return toToken(TokenType::__EOF);
+      yytext = matched;
+      return toToken(tokenType);
     }
-
-    throwUnexpectedToken(std::string(1, strSlice[0]), currentLine_,
-                         currentColumn_);
   }
 
   /**
    * Whether the cursor is at the EOF.
    */
-  inline bool isEOF() { return cursor_ == str_.length(); }
+  inline bool isEOF() { return cursor_ == input_.length(); }
 
-  SharedToken toToken(TokenType tokenType) {
-    return std::shared_ptr<Token>(new Token{
+  Token toToken(TokenType tokenType) {
+    return Token{
         .type = tokenType,
-        .value = yytext,
-        .startOffset = tokenStartOffset_,
-        .endOffset = tokenEndOffset_,
-        .startLine = tokenStartLine_,
-        .endLine = tokenEndLine_,
-        .startColumn = tokenStartColumn_,
-        .endColumn = tokenEndColumn_,
-    });
+        .offset = (uint32_t)tokenStartOffset_,
+        .length = tokenType == TokenType::__EOF ? 0 : (uint32_t)yytext.size(),
+        .line = tokenStartLine_,
+        .column = tokenStartColumn_,
+    };
+  }
+
+  /**
+   * Text of a token.
+   */
+  std::string_view text(const Token& token) const {
+    return token.type == TokenType::__EOF
+               ? __EOF
+               : input_.substr(token.offset, token.length);
   }
 
   /**
@@ -290,16 +324,18 @@ class Tokenizer {
    * line from the source, pointing with the ^ marker to the bad token.
    * In addition, shows `line:column` location.
    */
-  [[noreturn]] void throwUnexpectedToken(const std::string& symbol, int line,
+  [[noreturn]] void throwUnexpectedToken(std::string_view symbol, int line,
                                          int column) {
-    std::stringstream ss{str_};
-    std::string lineStr;
+    size_t lineBegin = 0;
     int currentLine = 1;
 
-    while (currentLine++ <= line) {
-      std::getline(ss, lineStr, '\n');
+    while (currentLine++ < line) {
+      lineBegin = input_.find('\n', lineBegin) + 1;
     }
 
+    auto lineStr = input_.substr(lineBegin);
+    lineStr = lineStr.substr(0, lineStr.find('\n'));
+
     auto pad = std::string(column, ' ');
 
     std::stringstream errMsg;
@@ -316,13 +352,109 @@ class Tokenizer {
   /**
    * Matched text.
    */
-  std::string yytext;
+  std::string_view yytext;
 
  private:
+  /**
+   * Matches a token at the cursor, returns its length (0 if no rule
+   * matches), and sets the token type (`__EMPTY` for skipped tokens).
+   */
+  size_t matchToken_(TokenType& type) {
+    auto begin = input_.data() + cursor_;
+    auto end = input_.data() + input_.length();
+    auto p = begin;
+
+    switch (*p) {
+      // '('
+      case '(':
+        type = TokenType::TOKEN_TYPE_7;
+        return 1;
+
+      // ')'
+      case ')':
+        type = TokenType::TOKEN_TYPE_8;
+        return 1;
+
+      // \/\/.*
+      // \/\*[\s\S]*?\*\/
+      case '/':
+        if (end - p > 1 && p[1] == '/') {
+          p += 2;
+          while (p < end && *p != '\n' && *p != '\r') {
+            p++;
+          }
+          type = TokenType::__EMPTY;
+          return p - begin;
+        }
+
+        if (end - p > 1 && p[1] == '*' && !unclosedComment_) {
+          auto close = input_.find("*/", cursor_ + 2);
+          if (close != std::string_view::npos) {
+            type = TokenType::__EMPTY;
+            return close + 2 - cursor_;
+          }
+
+          // No `*/` till the end of input, don't rescan on next `/*`.
+          unclosedComment_ = true;
+        }
+        break;
+
+      // \"(?:[^\"\\]|\\[\s\S])*\"
+      case '"':
+        for (p++; p < end; p++) {
+          if (*p == '\\' && end - p > 1) {
+            p++;
+          } else if (*p == '"') {
+            type = TokenType::STRING;
+            return p + 1 - begin;
+          }
+        }
+        return 0;
+    }
+
+    // \s+
+    if (charClasses_.is(*p, CC_SPACE)) {
+      while (p < end && charClasses_.is(*p, CC_SPACE)) {
+        p++;
+      }
+      type = TokenType::__EMPTY;
+      return p - begin;
+    }
+
+    // -?\d+(\.\d+)?
+    if (*p == '-' && end - p > 1 && charClasses_.is(p[1], CC_DIGIT)) {
+      p++;
+    }
+    if (charClasses_.is(*p, CC_DIGIT)) {
+      while (p < end && charClasses_.is(*p, CC_DIGIT)) {
+        p++;
+      }
+      if (end - p > 1 && p[0] == '.' && charClasses_.is(p[1], CC_DIGIT)) {
+        p++;
+        while (p < end && charClasses_.is(*p, CC_DIGIT)) {
+          p++;
+        }
+      }
+      type = TokenType::NUMBER;
+      return p - begin;
+    }
+
+    // [\w\-+*=!<>/]+
+    if (charClasses_.is(*p, CC_SYMBOL)) {
+      while (p < end && charClasses_.is(*p, CC_SYMBOL)) {
+        p++;
+      }
+      type = TokenType::SYMBOL;
+      return p - begin;
+    }
+
+    return 0;
+  }
+
   /**
    * Captures token locations.
    */
-  void captureLocations_(const std::string& matched) {
+  void captureLocations_(std::string_view matched) {
     auto len = matched.length();
 
     // Absolute offsets.
@@ -333,13 +465,11 @@ class Tokenizer {
     tokenStartColumn_ = tokenStartOffset_ - currentLineBeginOffset_;
 
     // Extract `\n` in the matched token.
-    std::stringstream ss{matched};
-    std::string lineStr;
-    std::getline(ss, lineStr, '\n');
-    while (ss.tellg() > 0 && ss.tellg() <= len) {
+    auto nl = matched.find('\n');
+    while (nl != std::string_view::npos) {
       currentLine_++;
-      currentLineBeginOffset_ = tokenStartOffset_ + ss.tellg();
-      std::getline(ss, lineStr, '\n');
+      currentLineBeginOffset_ = tokenStartOffset_ + nl + 1;
+      nl = matched.find('\n', nl + 1);
     }
 
     tokenEndOffset_ = cursor_ + len;
@@ -351,28 +481,28 @@ class Tokenizer {
   }
 
   /**
-   * Lexical rules.
+   * Character classes of the lexical grammar.
    */
-  // clang-format off
-  static constexpr size_t LEX_RULES_COUNT = 8;
-  static std::array<LexRule, LEX_RULES_COUNT> lexRules_;
-  static std::map<TokenizerState, std::vector<size_t>> lexRulesByStartConditions_;
-  // clang-format on
+  static constexpr CharClassTable charClasses_{};
 
   /**
    * Special EOF token.
    */
-  static std::string __EOF;
+  static constexpr std::string_view __EOF = "$";
 
   /**
-   * Tokenizing string.
+   * Tokenizing string (not owned).
    */
-  std::string str_;
+  std::string_view input_;
 
   /**
    * Cursor for current symbol.
    */
-  int cursor_;
+  size_t cursor_;
+
+  // Whether an unclosed block comment was seen: the rest of the input
+  // has no closing "*" "/", so there's no need to rescan for it.
+  bool unclosedComment_;
 
   /**
    * States.
@@ -384,74 +514,19 @@ class Tokenizer {
    */
   int currentLine_;
   int currentColumn_;
-  int currentLineBeginOffset_;
+  size_t currentLineBeginOffset_;
 
   /**
    * Location data of a matched token.
    */
-  int tokenStartOffset_;
-  int tokenEndOffset_;
+  size_t tokenStartOffset_;
+  size_t tokenEndOffset_;
   int tokenStartLine_;
   int tokenEndLine_;
   int tokenStartColumn_;
   int tokenEndColumn_;
 };
 
-// ------------------------------------------------------------------
-// Lexical rule handlers.
-
-std::string Tokenizer::__EOF("$");
-
-// clang-format off
-inline TokenType _lexRule1(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::TOKEN_TYPE_7;
-}
-
-inline TokenType _lexRule2(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::TOKEN_TYPE_8;
-}
-
-inline TokenType _lexRule3(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::__EMPTY;
-}
-
-inline TokenType _lexRule4(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::__EMPTY;
-}
-
-inline TokenType _lexRule5(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::__EMPTY;
-}
-
-inline TokenType _lexRule6(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::STRING;
-}
-
-inline TokenType _lexRule7(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::NUMBER;
-}
-
-inline TokenType _lexRule8(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::SYMBOL;
-}
-// clang-format on
-
-// ------------------------------------------------------------------
-// Lexical rules.
-
-// clang-format off
-std::array<LexRule, Tokenizer::LEX_RULES_COUNT> Tokenizer::lexRules_ = {{
-  {std::regex(R"(^\()"), &_lexRule1},
-  {std::regex(R"(^\))"), &_lexRule2},
-  {std::regex(R"(^\/\/.*)"), &_lexRule3},
-  {std::regex(R"(^\/\*[\s\S]*?\*\/)"), &_lexRule4},
-  {std::regex(R"(^\s+)"), &_lexRule5},
-  {std::regex(R"(^"[^\"]*")"), &_lexRule6},
-  {std::regex(R"(^\d+)"), &_lexRule7},
-  {std::regex(R"(^[\w\-+*=!<>/]+)"), &_lexRule8}
-}};
-std::map<TokenizerState, std::vector<size_t>> Tokenizer::lexRulesByStartConditions_ =  {{TokenizerState::INITIAL, {0, 1, 2, 3, 4, 5, 6, 7}}};
-// clang-format on
 
 #endif
 // clang-format on
@@ -460,8 +535,8 @@ std::map<TokenizerState, std::vector<size_t>> Tokenizer::lexRulesByStartConditio
   parser.valuesStack.back(); \
   parser.valuesStack.pop_back()
 
-#define POP_T()              \
-  parser.tokensStack.back(); \
+#define POP_T()                                \
+  parser.tokenText(parser.tokensStack.back()); \
   parser.tokensStack.pop_back()
 
 #define PUSH_VR() parser.valuesStack.push_back(__)
@@ -470,7 +545,8 @@ std::map<TokenizerState, std::vector<size_t>> Tokenizer::lexRulesByStartConditio
 /**
  * Parsing table type.
  */
-enum class TE {
+enum class TE : uint8_t {
+  Error,
   Accept,
   Shift,
   Reduce,
@@ -478,11 +554,11 @@ enum class TE {
 };
 
 /**
- * Parsing table entry.
+ * Parsing table entry. Empty cells (`{}`) are errors.
  */
 struct TableEntry {
   TE type;
-  int value;
+  int16_t value;
 };
 
 // clang-format off
@@ -505,9 +581,9 @@ struct Production {
   ProductionHandler handler;
 };
 
-// Key: Encoded symbol (terminal or non-terminal) index
+// Row: state
+// Column: encoded symbol (terminal or non-terminal) index
 // Value: TableEntry
-using Row = std::map<int, TableEntry>;
 
 /**
  * Parser class.
@@ -522,9 +598,14 @@ class EvaParser {
   std::vector<Value> valuesStack;
 
   /**
-   * Token values stack.
+   * Tokens of the parsing string.
+   */
+  std::vector<Token> tokens;
+
+  /**
+   * Token values stack: positions of the shifted tokens.
    */
-  std::vector<std::string> tokensStack;
+  std::vector<uint32_t> tokensStack;
 
   /**
    * Parsing states stack.
@@ -536,22 +617,46 @@ class EvaParser {
    */
   Tokenizer tokenizer;
 
+  /**
+   * AST arena, owns the nodes of the last parsed string.
+   */
+  AstArena ast;
+
   /**
    * Previous state to calculate the next one.
    */
   int previousState;
 
+  /**
+   * Tokens read by the last parse, and the time spent tokenizing
+   * (measured only if `timeTokenizer` is set).
+   */
+  bool timeTokenizer = false;
+  size_t tokensCount = 0;
+  std::chrono::steady_clock::duration tokenizerTime{};
+
   /**
    * Parses a string.
    */
-  Value parse(const std::string& str) {
+  Value parse(std::string_view str) {
     // clang-format off
     
     // clang-format on
 
+    // Token offsets are 32-bit.
+    if (str.size() > MAX_INPUT_SIZE) {
+      throw ValueError("Input too large: " + std::to_string(str.size()) +
+                           " bytes, a form is at most " +
+                           std::to_string(MAX_INPUT_SIZE) + " bytes.",
+                       1, 0);
+    }
+
     // Initialize the tokenizer and the string.
     tokenizer.initString(str);
 
+    // Drop the previous AST.
+    ast.reset();
+
     // Initialize the stacks.
     valuesStack.clear();
     tokensStack.clear();
@@ -560,58 +665,52 @@ class EvaParser {
     // Initial 0 state.
     statesStack.push_back(0);
 
-    auto token = tokenizer.getNextToken();
-    auto shiftedToken = token;
+    // Tokenize the whole string into the (reused) tokens buffer.
+    tokenize();
+
+    // Current token, and the last shifted one.
+    uint32_t token = 0;
+    uint32_t shiftedToken = 0;
 
     // Main parsing loop.
     for (;;) {
-      auto state = statesStack.back();
-      auto column = (int)token->type;
-
-      if (table_[state].count(column) == 0) {
-        throwUnexpectedToken(token);
-      }
-
-      auto entry = table_[state].at(column);
+      const auto& entry = table_[statesStack.back()][(int)tokens[token].type];
 
       // Shift a token, go to state.
       if (entry.type == TE::Shift) {
         // Push token.
-        tokensStack.push_back(token->value);
+        tokensStack.push_back(token);
 
         // Push next state number: "s5" -> 5
         statesStack.push_back(entry.value);
 
-        shiftedToken = token;
-        token = tokenizer.getNextToken();
+        shiftedToken = token++;
       }
 
       // Reduce by production.
       else if (entry.type == TE::Reduce) {
-        auto productionNumber = entry.value;
-        auto production = productions_[productionNumber];
-
-        tokenizer.yytext = shiftedToken->value;
+        const auto& production = productions_[entry.value];
 
-        auto rhsLength = production.rhsLength;
-        while (rhsLength > 0) {
-          statesStack.pop_back();
-          rhsLength--;
-        }
+        tokenizer.yytext = tokenText(shiftedToken);
 
-        // Call the handler.
-        production.handler(*this);
+        statesStack.resize(statesStack.size() - production.rhsLength);
 
-        auto previousState = statesStack.back();
+        // Call the handler (values of the tokens are checked by the AST).
+        try {
+          production.handler(*this);
+        } catch (const std::runtime_error& error) {
+          const auto& shifted = tokens[shiftedToken];
+          throw ValueError(error.what(), shifted.line, shifted.column);
+        }
 
-        auto symbolToReduceWith = production.opcode;
-        auto nextStateEntry = table_[previousState].at(symbolToReduceWith);
+        const auto& nextStateEntry =
+            table_[statesStack.back()][production.opcode];
         assert(nextStateEntry.type == TE::Transit);
 
         statesStack.push_back(nextStateEntry.value);
       }
 
-      // Accept the string.
+      // Accept the string (on `__EOF`, the last token).
       else if (entry.type == TE::Accept) {
         // Pop state number.
         statesStack.pop_back();
@@ -621,8 +720,7 @@ class EvaParser {
         auto result = valuesStack.back(); valuesStack.pop_back();
         // clang-format on
 
-        if (statesStack.size() != 1 || statesStack.back() != 0 ||
-            tokenizer.hasMoreTokens()) {
+        if (statesStack.size() != 1 || statesStack.back() != 0) {
           throwUnexpectedToken(token);
         }
 
@@ -634,21 +732,56 @@ class EvaParser {
 
         return result;
       }
+
+      // No action for the token in this state.
+      else {
+        throwUnexpectedToken(token);
+      }
     }
   }
 
+  /**
+   * Offset of the last shifted token in the parsed string (in a
+   * handler: the "(" of the list being opened).
+   */
+  uint32_t shiftedOffset() const { return tokens[tokensStack.back()].offset; }
+
+  /**
+   * Text of the token at the position.
+   */
+  std::string_view tokenText(uint32_t position) const {
+    return tokenizer.text(tokens[position]);
+  }
+
  private:
+  /**
+   * Tokenizes the parsing string, updating the tokenizer statistics.
+   */
+  void tokenize() {
+    if (!timeTokenizer) {
+      tokenizer.tokenize(tokens);
+    } else {
+      auto start = std::chrono::steady_clock::now();
+      tokenizer.tokenize(tokens);
+      tokenizerTime = std::chrono::steady_clock::now() - start;
+    }
+
+    tokensCount = tokens.size();
+  }
+
   /**
    * Throws parser error on unexpected token.
    */
-  [[noreturn]] void throwUnexpectedToken(SharedToken token) {
-    if (token->type == TokenType::__EOF && !tokenizer.hasMoreTokens()) {
+  [[noreturn]] void throwUnexpectedToken(uint32_t position) {
+    const auto& token = tokens[position];
+
+    if (token.type == TokenType::__EOF) {
       std::string errMsg = "Unexpected end of input.\n";
       std::cerr << errMsg;
       throw std::runtime_error(errMsg.c_str());
     }
-    tokenizer.throwUnexpectedToken(token->value, token->startLine,
-                                   token->startColumn);
+    tokenizer.throwUnexpectedToken(tokenizer.text(token), token.line,
+                                   token.column);
   }
 
   // clang-format off
@@ -656,7 +789,8 @@ class EvaParser {
   static std::array<Production, PRODUCTIONS_COUNT> productions_;
 
   static constexpr size_t ROWS_COUNT = 11;
-  static std::array<Row, ROWS_COUNT> table_;
+  static constexpr size_t COLUMNS_COUNT = 10;
+  static const TableEntry table_[ROWS_COUNT][COLUMNS_COUNT];
   // clang-format on
 };
 
@@ -701,7 +835,7 @@ void _handler4(yyparse& parser) {
 // Semantic action prologue.
 auto _1 = POP_T();
 
-auto __ = Exp(std::stoi(_1)) ;
+auto __ = parser.ast.number(_1) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -712,7 +846,7 @@ void _handler5(yyparse& parser) {
 // Semantic action prologue.
 auto _1 = POP_T();
 
-auto __ = Exp(_1) ;
+auto __ = parser.ast.string(_1) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -723,7 +857,7 @@ void _handler6(yyparse& parser) {
 // Semantic action prologue.
 auto _1 = POP_T();
 
-auto __ = Exp(_1) ;
+auto __ = parser.ast.symbol(_1) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -736,7 +870,7 @@ parser.tokensStack.pop_back();
 auto _2 = POP_V();
 parser.tokensStack.pop_back();
 
-auto __ = _2 ;
+auto __ = parser.ast.endList(_2) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -747,7 +881,7 @@ void _handler8(yyparse& parser) {
 // Semantic action prologue.
 
 
-auto __ = Exp(std::vector<Exp>{}) ;
+auto __ = parser.ast.beginList(parser.shiftedOffset()) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -759,7 +893,7 @@ void _handler9(yyparse& parser) {
 auto _2 = POP_V();
 auto _1 = POP_V();
 
-_1.list.push_back(_2); auto __ = _1 ;
+parser.ast.append(_1, _2); auto __ = _1 ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -782,19 +916,21 @@ std::array<Production, yyparse::PRODUCTIONS_COUNT> yyparse::productions_ = {{{-1
 // ------------------------------------------------------------------
 // Parsing table.
 
+// Dense table: one cell per state and symbol, found by indexing.
+//
 // clang-format off
-std::array<Row, yyparse::ROWS_COUNT> yyparse::table_ = {
-    Row {{0, {TE::Transit, 1}}, {1, {TE::Transit, 2}}, {2, {TE::Transit, 3}}, {4, {TE::Shift, 4}}, {5, {TE::Shift, 5}}, {6, {TE::Shift, 6}}, {7, {TE::Shift, 7}}},
-    Row {{9, {TE::Accept, 0}}},
-    Row {{4, {TE::Reduce, 1}}, {5, {TE::Reduce, 1}}, {6, {TE::Reduce, 1}}, {7, {TE::Reduce, 1}}, {8, {TE::Reduce, 1}}, {9, {TE::Reduce, 1}}},
-    Row {{4, {TE::Reduce, 2}}, {5, {TE::Reduce, 2}}, {6, {TE::Reduce, 2}}, {7, {TE::Reduce, 2}}, {8, {TE::Reduce, 2}}, {9, {TE::Reduce, 2}}},
-    Row {{4, {TE::Reduce, 3}}, {5, {TE::Reduce, 3}}, {6, {TE::Reduce, 3}}, {7, {TE::Reduce, 3}}, {8, {TE::Reduce, 3}}, {9, {TE::Reduce, 3}}},
-    Row {{4, {TE::Reduce, 4}}, {5, {TE::Reduce, 4}}, {6, {TE::Reduce, 4}}, {7, {TE::Reduce, 4}}, {8, {TE::Reduce, 4}}, {9, {TE::Reduce, 4}}},
-    Row {{4, {TE::Reduce, 5}}, {5, {TE::Reduce, 5}}, {6, {TE::Reduce, 5}}, {7, {TE::Reduce, 5}}, {8, {TE::Reduce, 5}}, {9, {TE::Reduce, 5}}},
-    Row {{3, {TE::Transit, 8}}, {4, {TE::Reduce, 7}}, {5, {TE::Reduce, 7}}, {6, {TE::Reduce, 7}}, {7, {TE::Reduce, 7}}, {8, {TE::Reduce, 7}}},
-    Row {{0, {TE::Transit, 10}}, {1, {TE::Transit, 2}}, {2, {TE::Transit, 3}}, {4, {TE::Shift, 4}}, {5, {TE::Shift, 5}}, {6, {TE::Shift, 6}}, {7, {TE::Shift, 7}}, {8, {TE::Shift, 9}}},
-    Row {{4, {TE::Reduce, 6}}, {5, {TE::Reduce, 6}}, {6, {TE::Reduce, 6}}, {7, {TE::Reduce, 6}}, {8, {TE::Reduce, 6}}, {9, {TE::Reduce, 6}}},
-    Row {{4, {TE::Reduce, 8}}, {5, {TE::Reduce, 8}}, {6, {TE::Reduce, 8}}, {7, {TE::Reduce, 8}}, {8, {TE::Reduce, 8}}}
+const TableEntry yyparse::table_[yyparse::ROWS_COUNT][yyparse::COLUMNS_COUNT] = {
+    {{TE::Transit, 1}, {TE::Transit, 2}, {TE::Transit, 3}, {}, {TE::Shift, 4}, {TE::Shift, 5}, {TE::Shift, 6}, {TE::Shift, 7}, {}, {}},
+    {{}, {}, {}, {}, {}, {}, {}, {}, {}, {TE::Accept, 0}},
+    {{}, {}, {}, {}, {TE::Reduce, 1}, {TE::Reduce, 1}, {TE::Reduce, 1}, {TE::Reduce, 1}, {TE::Reduce, 1}, {TE::Reduce, 1}},
+    {{}, {}, {}, {}, {TE::Reduce, 2}, {TE::Reduce, 2}, {TE::Reduce, 2}, {TE::Reduce, 2}, {TE::Reduce, 2}, {TE::Reduce, 2}},
+    {{}, {}, {}, {}, {TE::Reduce, 3}, {TE::Reduce, 3}, {TE::Reduce, 3}, {TE::Reduce, 3}, {TE::Reduce, 3}, {TE::Reduce, 3}},
+    {{}, {}, {}, {}, {TE::Reduce, 4}, {TE::Reduce, 4}, {TE::Reduce, 4}, {TE::Reduce, 4}, {TE::Reduce, 4}, {TE::Reduce, 4}},
+    {{}, {}, {}, {}, {TE::Reduce, 5}, {TE::Reduce, 5}, {TE::Reduce, 5}, {TE::Reduce, 5}, {TE::Reduce, 5}, {TE::Reduce, 5}},
+    {{}, {}, {}, {TE::Transit, 8}, {TE::Reduce, 7}, {TE::Reduce, 7}, {TE::Reduce, 7}, {TE::Reduce, 7}, {TE::Reduce, 7}, {}},
+    {{TE::Transit, 10}, {TE::Transit, 2}, {TE::Transit, 3}, {}, {TE::Shift, 4}, {TE::Shift, 5}, {TE::Shift, 6}, {TE::Shift, 7}, {TE::Shift, 9}, {}},
+    {{}, {}, {}, {}, {TE::Reduce, 6}, {TE::Reduce, 6}, {TE::Reduce, 6}, {TE::Reduce, 6}, {TE::Reduce, 6}, {TE::Reduce, 6}},
+    {{}, {}, {}, {}, {TE::Reduce, 8}, {TE::Reduce, 8}, {TE::Reduce, 8}, {TE::Reduce, 8}, {TE::Reduce, 8}, {}}
 };
 // clang-format on
 
@@ -0,0 +1,265 @@
+/**
+ * Reader of top-level forms from a stream or a memory buffer.
+ */
+
+#ifndef FormReader_h
+#define FormReader_h
+
+#include <algorithm>
+#include <istream>
+#include <string>
+#include <string_view>
+
+#include "EvaParser.h"
+
+/**
+ * Splits a program into its top-level forms. A stream is read in
+ * chunks of the buffered input, or line by line when nothing is
+ * buffered (a terminal, a pipe): only the text of the current form is
+ * kept in memory. A memory
+ * buffer (e.g. a mapped file) is split in place, without copying.
+ *
+ * Forms are delimited following the lexical grammar (strings and
+ * comments may contain parens), but are not validated: a malformed form
+ * is returned as is, and reported by the parser.
+ */
+class FormReader {
+  public:
+    explicit FormReader(std::istream& in) : in_(&in) {}
+
+    explicit FormReader(std::string_view text) : text_(text) {}
+
+    /**
+     * Reads the next top-level form. Returns false at the end of input.
+     * The form text of a stream is valid until the next call, and the
+     * one of a memory buffer as long as the buffer.
+     */
+    bool next(std::string_view& form) {
+      // The previous form may be dropped (on the next fill).
+      keep_ = end_;
+
+      auto p = end_;
+      auto start = std::string_view::npos;
+      auto depth = 0;
+      complete_ = true;
+
+      for (;;) {
+        auto c = at(p);
+
+        if (c == EOF_) {
+          if (start == std::string_view::npos) {
+            return false;
+          }
+          // Unterminated form.
+          complete_ = false;
+          break;
+        }
+
+        // Whitespace:
+        if (charClasses_.is(c, syntax::CC_SPACE)) {
+          p++;
+          continue;
+        }
+
+        // Comments:
+        if (c == '/' && at(p + 1) == '/') {
+          p += 2;
+          while ((c = at(p)) != EOF_ && c != '\n' && c != '\r') {
+            p++;
+          }
+          continue;
+        }
+
+        if (c == '/' && at(p + 1) == '*') {
+          auto close = findCommentEnd(p + 2);
+          if (close != std::string::npos) {
+            p = close + 2;
+            continue;
+          }
+          // Unclosed comment: lexed as a symbol.
+        }
+
+        if (start == std::string_view::npos) {
+          start = p;
+        }
+
+        // Strings:
+        if (c == '"') {
+          p++;
+          while ((c = at(p)) != EOF_ && c != '"') {
+            // Escape: \"
+            if (c == '\\' && at(p + 1) != EOF_) {
+              p++;
+            }
+            p++;
+          }
+          if (c == '"') {
+            p++;
+          }
+        }
+
+        // Lists:
+        else if (c == '(') {
+          depth++;
+          p++;
+        }
+
+        else if (c == ')') {
+          depth--;
+          p++;
+        }
+
+        // Numbers, Symbols:
+        else if (charClasses_.is(c, syntax::CC_SYMBOL)) {
+          auto isNumber = charClasses_.is(c, syntax::CC_DIGIT) ||
+                          (c == '-' &&
+                           charClasses_.is(at(p + 1), syntax::CC_DIGIT));
+
+          while ((c = at(p)) != EOF_ && charClasses_.is(c, syntax::CC_SYMBOL)) {
+            p++;
+          }
+
+          // Fraction of a number: 3.14
+          if (c == '.' && isNumber &&
+              charClasses_.is(at(p + 1), syntax::CC_DIGIT)) {
+            p++;
+            while ((c = at(p)) != EOF_ && charClasses_.is(c, syntax::CC_DIGIT)) {
+              p++;
+            }
+          }
+        }
+
+        // Unexpected char, reported by the parser.
+        else {
+          p++;
+        }
+
+        if (depth <= 0) {
+          break;
+        }
+      }
+
+      end_ = p;
+      form = text_.substr(start - offset_, p - start);
+      return true;
+    }
+
+    /**
+     * Whether the last form read is complete: false if the input ended
+     * inside of it (e.g. an unclosed list, while more lines are typed).
+     */
+    bool complete() const { return complete_; }
+
+  private:
+    /**
+     * Returns the char at the position, reading more input if needed, or
+     * EOF_ at the end of input.
+     */
+    int at(size_t pos) {
+      while (pos - offset_ >= text_.size()) {
+        if (!fill()) {
+          return EOF_;
+        }
+      }
+      return (unsigned char)text_[pos - offset_];
+    }
+
+    /**
+     * Returns the position of the "*" "/" closing a block comment.
+     */
+    size_t findCommentEnd(size_t pos) {
+      for (;;) {
+        auto close = text_.find("*/", pos - offset_);
+        if (close != std::string::npos) {
+          return close + offset_;
+        }
+        pos = offset_ + (text_.empty() ? 0 : text_.size() - 1);
+        if (!fill()) {
+          return std::string::npos;
+        }
+      }
+    }
+
+    /**
+     * Appends the next chunk of the stream to the buffer, first dropping
+     * the forms already read. The buffer is compacted once per chunk,
+     * not once per form.
+     */
+    bool fill() {
+      if (in_ == nullptr) {
+        return false;
+      }
+
+      if (keep_ > offset_) {
+        buffer_.erase(0, keep_ - offset_);
+        offset_ = keep_;
+      }
+
+      auto size = buffer_.size();
+      auto available = in_->rdbuf()->in_avail();
+
+      if (available > 0) {
+        // Buffered input (e.g. a file): take a chunk of it.
+        auto count = std::min<size_t>(available, CHUNK_SIZE);
+        buffer_.resize(size + count);
+        buffer_.resize(size + in_->readsome(&buffer_[size], count));
+      } else {
+        // Terminal or pipe: wait for one line only, a full chunk may
+        // never come.
+        std::string line;
+        if (std::getline(*in_, line)) {
+          buffer_ += line;
+          if (!in_->eof()) {
+            buffer_ += '\n';
+          }
+        }
+      }
+
+      text_ = buffer_;
+      return buffer_.size() > size;
+    }
+
+    static constexpr int EOF_ = -1;
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * Character classes of the lexical grammar.
+     */
+    static constexpr syntax::CharClassTable charClasses_{};
+
+    /**
+     * Input stream, null for a memory buffer.
+     */
+    std::istream* in_ = nullptr;
+
+    /**
+     * Stream text read so far: the current form (and maybe the previous
+     * ones), and the input read ahead.
+     */
+    std::string buffer_;
+
+    /**
+     * Text being split: the stream buffer, or the memory buffer.
+     */
+    std::string_view text_;
+
+    /**
+     * Positions are in the whole input: `offset_` is the one of the
+     * start of the text (0 for a memory buffer), and the text from
+     * `keep_` on is still needed.
+     */
+    size_t offset_ = 0;
+    size_t keep_ = 0;
+
+    /**
+     * End of the current form in the input.
+     */
+    size_t end_ = 0;
+
+    /**
+     * Whether the current form is complete.
+     */
+    bool complete_ = true;
+};
+
+#endif//FormReader_h
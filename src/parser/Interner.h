@@ -0,0 +1,73 @@
+/**
+ * String interner: symbol names and string literals.
+ */
+
+#ifndef Interner_h
+#define Interner_h
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Interned string handle: a dense index into the interner.
+ */
+using Symbol = uint32_t;
+
+/**
+ * Interner: maps each distinct string to a stable handle.
+ *
+ * Interned strings are stored once, and the views returned by `name`
+ * stay valid for the lifetime of the interner. Looking up an already
+ * interned string does not allocate.
+ */
+class Interner {
+  public:
+    /**
+     * Returns the handle of the given string, interning it if needed.
+     * A borrowed string is not copied: it should outlive the interner.
+     */
+    Symbol intern(std::string_view str, bool borrow = false) {
+      auto it = ids_.find(str);
+      if (it != ids_.end()) {
+        return it->second;
+      }
+
+      auto stored = borrow ? str : std::string_view(strings_.emplace_back(str));
+      auto id = (Symbol)names_.size();
+      names_.push_back(stored);
+      ids_.emplace(stored, id);
+      return id;
+    }
+
+    /**
+     * Returns the string of the given handle.
+     */
+    std::string_view name(Symbol id) const { return names_[id]; }
+
+    /**
+     * Number of interned strings.
+     */
+    size_t size() const { return names_.size(); }
+
+  private:
+    /**
+     * String -> handle.
+     */
+    std::unordered_map<std::string_view, Symbol> ids_;
+
+    /**
+     * Handle -> string.
+     */
+    std::vector<std::string_view> names_;
+
+    /**
+     * Copied strings storage (deque never moves its elements).
+     */
+    std::deque<std::string> strings_;
+};
+
+#endif//Interner_h